@@ -0,0 +1,87 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Batched sampling works on a tile of running sums (powers x batch)
+// Pick a batch so the tile (plus the dx and dx^p rows) stays in L1 cache,
+// or L2 if there are too many powers for a useful L1 tile.
+
+#include <unistd.h>
+
+#define BATCH_MIN 8
+#define BATCH_MAX 4096
+
+static inline int batch_autosize( int powers )
+{
+    long cache = sysconf( _SC_LEVEL1_DCACHE_SIZE ) ;
+    if ( cache <= 0 ) {
+        cache = 32768 ;
+    }
+    // doubles per sample in the batch: the powers' running sums, dx, and dx^p
+    long per_sample = ( powers + 2 ) * sizeof(double) ;
+    long batch = cache / 2 / per_sample ; // leave half of L1 for everything else
+    if ( batch < BATCH_MIN ) {
+        long cache2 = sysconf( _SC_LEVEL2_CACHE_SIZE ) ;
+        if ( cache2 > 0 ) {
+            batch = cache2 / 2 / per_sample ;
+        }
+    }
+    batch -= batch % BATCH_MIN ; // whole vector lanes
+    if ( batch < BATCH_MIN ) {
+        batch = BATCH_MIN ;
+    } else if ( batch > BATCH_MAX ) {
+        batch = BATCH_MAX ;
+    }
+    return (int) batch ;
+}
+
+// --precision for the batched engine
+//   fp64  double throughout
+//   mixed float dx and running sums, double totals
+//   fp32  float dx and running sums, compensated (Kahan) float totals
+enum precision { PRECISION_FP64, PRECISION_MIXED, PRECISION_FP32 } ;
+
+#include <string.h>
+
+// name -> precision (-1 if unknown)
+static inline int precision_parse( const char * name )
+{
+    if ( strcmp( name, "fp32" ) == 0 ) {
+        return PRECISION_FP32 ;
+    } else if ( strcmp( name, "mixed" ) == 0 ) {
+        return PRECISION_MIXED ;
+    } else if ( strcmp( name, "fp64" ) == 0 ) {
+        return PRECISION_FP64 ;
+    }
+    return -1 ;
+}
+
+static inline const char * precision_name( enum precision precision )
+{
+    switch ( precision ) {
+    case PRECISION_FP32:
+        return "fp32" ;
+    case PRECISION_MIXED:
+        return "mixed" ;
+    default:
+        return "fp64" ;
+    }
+}
+
+// The batch loops are compiled for the baseline processor and again for AVX2
+// and AVX-512, and the loader picks the best copy (gcc on x86-64 linux)
+// -- wider vectors without giving up a portable binary (-DNO_CLONES for one copy)
+#if ! defined( NO_CLONES ) && defined( __GNUC__ ) && ! defined( __clang__ ) && defined( __x86_64__ ) && defined( __linux__ )
+#define BATCH_CLONES __attribute__(( target_clones( "default", "avx2", "avx512f" ) ))
+#else
+#define BATCH_CLONES
+#endif
+
+// In reduced precision, every SHADOW_EVERY'th batch is repeated in double
+// from the same random numbers to measure the deviation
+#define SHADOW_EVERY 8
+
+#endif /* BATCH_H */
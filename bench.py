@@ -0,0 +1,266 @@
+#!/usr/bin/python3
+
+# Program to time the distance programs
+# part of distance -- finding average distance in an N-cube
+# by Paul H Alfille 2021
+# see http://github.com/alfille/distance
+
+# Each suite runs a few command lines and reports
+#   wall time (best of repeats)
+#   peak memory (resident set size)
+#   cache references and misses (if linux perf is installed)
+
+try:
+    import argparse # for parsing the command line
+except:
+    print("Please install the argparse module")
+    print("\tit should be part of the standard python3 distribution")
+    raise
+
+try:
+    import shutil # for finding perf
+except:
+    print("Please install the shutil module")
+    print("\tit should be part of the standard python3 distribution")
+    raise
+
+try:
+    import subprocess # for running the programs
+except:
+    print("Please install the subprocess module")
+    print("\tit should be part of the standard python3 distribution")
+    raise
+
+try:
+    import time # for wall clock
+except:
+    print("Please install the time module")
+    print("\tit should be part of the standard python3 distribution")
+    raise
+
+try:
+    import os # for the processor count
+except:
+    print("Please install the os module")
+    print("\tit should be part of the standard python3 distribution")
+    raise
+
+# Suites of (name, command line) to compare
+# Programs are run from the current directory -- "make all" first
+SUITES = {
+    "stream": [
+        ("prefix sums d=200 p=10",      "./distance -d 200 -p 10 -r 20000"),
+        ("stream d=200 p=10",           "./distance -d 200 -p 10 -r 20000 -s"),
+        ("prefix sums d=20000 p=20",    "./distance -d 20000 -p 20 -r 1000"),
+        ("stream d=20000 p=20",         "./distance -d 20000 -p 20 -r 1000 -s"),
+        ("any prefix d=200 p=1_10",     "./distance_any -d 200 -p 1_10 -r 5000"),
+        ("any stream d=200 p=1_10",     "./distance_any -d 200 -p 1_10 -r 5000 -s"),
+        ("x prefix d=200 p=10",         "./distance_x -d 200 -p 10 -r 5000"),
+        ("x stream d=200 p=10",         "./distance_x -d 200 -p 10 -r 5000 -s"),
+    ],
+    "batch": [
+        ("one at a time d=200 p=10",    "./distance -d 200 -p 10 -r 20000"),
+        ("stream d=200 p=10",           "./distance -d 200 -p 10 -r 20000 -s"),
+        ("batch 64 d=200 p=10",         "./distance -d 200 -p 10 -r 20000 -b 64"),
+        ("batch auto d=200 p=10",       "./distance -d 200 -p 10 -r 20000 -b 0"),
+        ("batch auto d=2000 p=100",     "./distance -d 2000 -p 100 -r 500 -b 0"),
+        ("one at a time d=2000 p=100",  "./distance -d 2000 -p 100 -r 500"),
+        ("any one at a time p=1_10",    "./distance_any -d 200 -p 1_10 -r 5000"),
+        ("any batch auto p=1_10",       "./distance_any -d 200 -p 1_10 -r 5000 -b 0"),
+    ],
+    "precision": [
+        ("fp64 batch d=200 p=10",       "./distance -d 200 -p 10 -r 20000 -b 0"),
+        ("mixed d=200 p=10",            "./distance -d 200 -p 10 -r 20000 --precision mixed"),
+        ("fp32 d=200 p=10",             "./distance -d 200 -p 10 -r 20000 --precision fp32"),
+        ("any fp64 batch p=1_10",       "./distance_any -d 200 -p 1_10 -r 20000 -b 0"),
+        ("any mixed p=1_10",            "./distance_any -d 200 -p 1_10 -r 20000 --precision mixed"),
+        ("any fp32 p=1_10",             "./distance_any -d 200 -p 1_10 -r 20000 --precision fp32"),
+    ],
+    "stitch": [
+        ("stitch.py 3 files",           "python3 ./stitch.py /tmp/bench_a.csv /tmp/bench_b.csv /tmp/bench_c.csv -s ::10"),
+        ("distance_stitch 3 files",     "./distance_stitch -s ::10 /tmp/bench_a.csv /tmp/bench_b.csv /tmp/bench_c.csv"),
+        ("stitch.py all columns",       "python3 ./stitch.py /tmp/bench_a.csv /tmp/bench_b.csv /tmp/bench_c.csv"),
+        ("distance_stitch all columns", "./distance_stitch /tmp/bench_a.csv /tmp/bench_b.csv /tmp/bench_c.csv"),
+    ],
+    "histogram": [
+        ("any d=200 p=1_10",            "./distance_any -d 200 -p 1_10 -r 5000"),
+        ("any d=200 p=1_10 quantiles",  "./distance_any -d 200 -p 1_10 -r 5000 -Q .05,.5,.95"),
+        ("any batch d=200 p=1_10",      "./distance_any -d 200 -p 1_10 -r 5000 -b 0"),
+        ("any batch quantiles",         "./distance_any -d 200 -p 1_10 -r 5000 -b 0 -Q .05,.5,.95"),
+    ],
+    "moments": [
+        ("prefix d=200 p=10",           "./distance -d 200 -p 10 -r 20000"),
+        ("prefix moments",              "./distance -d 200 -p 10 -r 20000 -M"),
+        ("batch d=200 p=10",            "./distance -d 200 -p 10 -r 20000 -b 0"),
+        ("batch moments",               "./distance -d 200 -p 10 -r 20000 -b 0 -M"),
+        ("stream d=200 p=10",           "./distance -d 200 -p 10 -r 20000 -s"),
+        ("stream moments",              "./distance -d 200 -p 10 -r 20000 -s -M"),
+    ],
+    "kernels": [
+        ("generic prefix d=100 p=3",    "./distance -d 100 -p 3 -r 100000 --generic"),
+        ("kernel prefix d=100 p=3",     "./distance -d 100 -p 3 -r 100000"),
+        ("generic prefix d=200 p=10",   "./distance -d 200 -p 10 -r 20000 --generic"),
+        ("kernel prefix d=200 p=10",    "./distance -d 200 -p 10 -r 20000"),
+        ("generic stream d=200 p=10",   "./distance -d 200 -p 10 -r 20000 -s --generic"),
+        ("kernel stream d=200 p=10",    "./distance -d 200 -p 10 -r 20000 -s"),
+        ("generic batch auto d=100 p=3", "./distance -d 100 -p 3 -r 100000 -b 0 --generic"),
+        ("kernel batch auto d=100 p=3", "./distance -d 100 -p 3 -r 100000 -b 0"),
+        ("generic batch 256 d=200 p=10", "./distance -d 200 -p 10 -r 20000 -b 256 --generic"),
+        ("kernel batch 256 d=200 p=10", "./distance -d 200 -p 10 -r 20000 -b 256"),
+    ],
+    "build": [
+        ("-O0 d=100 p=3",               "/tmp/bench_distance_O0 -d 100 -p 3 -r 100000"),
+        ("-O2 d=100 p=3",               "/tmp/bench_distance_O2 -d 100 -p 3 -r 100000"),
+        ("opt d=100 p=3",               "/tmp/bench_distance_opt -d 100 -p 3 -r 100000"),
+        ("pgo d=100 p=3",               "/tmp/bench_distance_pgo -d 100 -p 3 -r 100000"),
+        ("-O0 batch d=200 p=10",        "/tmp/bench_distance_O0 -d 200 -p 10 -r 20000 -b 0"),
+        ("-O2 batch d=200 p=10",        "/tmp/bench_distance_O2 -d 200 -p 10 -r 20000 -b 0"),
+        ("opt batch d=200 p=10",        "/tmp/bench_distance_opt -d 200 -p 10 -r 20000 -b 0"),
+        ("pgo batch d=200 p=10",        "/tmp/bench_distance_pgo -d 200 -p 10 -r 20000 -b 0"),
+        ("-O0 any batch p=1_10",        "/tmp/bench_distance_any_O0 -d 200 -p 1_10 -r 5000 -b 0"),
+        ("-O2 any batch p=1_10",        "/tmp/bench_distance_any_O2 -d 200 -p 1_10 -r 5000 -b 0"),
+        ("opt any batch p=1_10",        "/tmp/bench_distance_any_opt -d 200 -p 1_10 -r 5000 -b 0"),
+        ("pgo any batch p=1_10",        "/tmp/bench_distance_any_pgo -d 200 -p 1_10 -r 5000 -b 0"),
+    ],
+    "multi": [
+        ("distance p=10",               "./distance -d 200 -p 10 -r 20000 -b 0"),
+        ("distance_any p=1_10_.5",      "./distance_any -d 200 -p 1_10_.5 -r 20000 -b 0"),
+        ("distance_f p=1_10_.5",        "./distance_f -d 200 -p 1_10_.5 -r 20000 -b 0"),
+        ("all three in one pass",       "./distance_any -d 200 -p 1_10_.5 -I 10 -F 1_10_.5 -r 20000"),
+    ],
+    "refine": [
+        ("x stream d=100 p=10",         "./distance_x -d 100 -p 10 -r 20000 -s"),
+        ("x refine no snapshots",       "./distance_x -d 100 -p 10 -r 20000 -t 1 -f 1000"),
+        ("x refine snapshot 100/s",     "./distance_x -d 100 -p 10 -r 20000 -t 1 -f 0.01"),
+        ("x refine snapshot 1000/s",    "./distance_x -d 100 -p 10 -r 20000 -t 1 -f 0.001"),
+    ],
+}
+
+# Thread scaling: 1, 2, 4 ... threads up to every processor we may run on
+def thread_counts():
+    cpus = len( os.sched_getaffinity(0) )
+    counts = [1]
+    while counts[-1] * 2 < cpus:
+        counts.append( counts[-1] * 2 )
+    if cpus > 1:
+        counts.append( cpus )
+    return counts
+
+SUITES["threads"] = \
+    [("x t={}".format(t),           "./distance_x -d 200 -p 10 -r 40000 -t {}".format(t)) for t in thread_counts()] + \
+    [("x stream t={}".format(t),    "./distance_x -d 200 -p 10 -r 40000 -s -t {}".format(t)) for t in thread_counts()] + \
+    [("nn t={}".format(t),          "./distance_nn -d 20 -N 4000 -r 2 -S 1 -t {}".format(t)) for t in thread_counts()]
+
+# A sweep of mixed-cost jobs: one after another as separate programs, then on one pool
+SUITES["sweep"] = [
+    ("separate programs",           "sh /tmp/bench_sweep.sh"),
+    ("sweep 1 thread",              "./distance_sweep -S 1 -t 1 -o /tmp /tmp/bench_sweep.txt"),
+    ("sweep all threads",           "./distance_sweep -S 1 -o /tmp /tmp/bench_sweep.txt"),
+]
+
+# Suites that also show speedup and parallel efficiency against their t=1 case
+SCALING = [ "threads" ]
+
+# Shell commands to make input files for a suite (run once before timing)
+SETUP = {
+    # copies of each build (leaves the pgo build in place)
+    "build": [
+        "make -s -B distance distance_any OPT=-O0 && cp distance /tmp/bench_distance_O0 && cp distance_any /tmp/bench_distance_any_O0",
+        "make -s -B distance distance_any OPT=-O2 && cp distance /tmp/bench_distance_O2 && cp distance_any /tmp/bench_distance_any_O2",
+        "make -s opt && cp distance /tmp/bench_distance_opt && cp distance_any /tmp/bench_distance_any_opt",
+        "make -s pgo > /dev/null && cp distance /tmp/bench_distance_pgo && cp distance_any /tmp/bench_distance_any_pgo",
+    ],
+    # the same jobs as a job file and as separate command lines
+    "sweep": [
+        "printf 'p=1_3 d=1_20 r=200000\\nnorm=f p=.5,1,2 d=1_100 r=50000\\np=1_20 d=1_200 r=20000\\np=1,2,inf k=canberra d=1_50 r=100000\\n' > /tmp/bench_sweep.txt",
+        "( echo './distance_any -p 1_3 -d 20 -r 200000 -s' ; echo './distance_f -p .5,1,2 -d 100 -r 50000 -s' ; "
+        "echo './distance_any -p 1_20 -d 200 -r 20000 -s' ; echo './distance_any -p 1,2,inf -k canberra -d 50 -r 100000 -s' ) > /tmp/bench_sweep.sh",
+    ],
+    "stitch": [
+        "./distance_asym -d 5000 -p 1_1000 > /tmp/bench_a.csv",
+        "./distance_asym -d 5000 -p 1_1000 -n > /tmp/bench_b.csv",
+        "./distance_asym -d 5000 -p 1_1000 -o 0 > /tmp/bench_c.csv",
+    ],
+}
+
+PERF_EVENTS = "cache-references,cache-misses"
+
+def high_water( pid ):
+    """Peak resident memory (KB) of a running process, from /proc"""
+    try:
+        with open("/proc/{}/status".format(pid)) as status:
+            for line in status:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1])
+    except:
+        pass
+    return 0
+
+def run_once( command ):
+    """Run command, return (seconds, peak kilobytes)"""
+    # getrusage would include the python interpreter the child was forked from
+    # so sample the child's own high water mark while it runs
+    start = time.perf_counter()
+    proc = subprocess.Popen( command.split(), stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL )
+    peak = 0
+    while proc.poll() is None:
+        peak = max( peak, high_water( proc.pid ) )
+        time.sleep( 0.002 )
+    elapsed = time.perf_counter() - start
+    if proc.returncode != 0:
+        raise RuntimeError("{} failed with code {}".format(command,proc.returncode))
+    return elapsed, peak
+
+def run_perf( command ):
+    """Cache references and misses from perf stat (None if perf unavailable)"""
+    if shutil.which("perf") is None:
+        return None
+    out = subprocess.run( ["perf","stat","-x,","-e",PERF_EVENTS]+command.split(), stdout=subprocess.DEVNULL, stderr=subprocess.PIPE ).stderr.decode()
+    counts = {}
+    for line in out.splitlines():
+        fields = line.split(',')
+        if len(fields) > 2 and fields[2] in PERF_EVENTS.split(','):
+            try:
+                counts[fields[2]] = int(fields[0])
+            except:
+                counts[fields[2]] = None
+    return counts
+
+def run_suite( name, repeats ):
+    for command in SETUP.get( name, [] ):
+        subprocess.run( command, shell=True, check=True )
+    print("Suite: {}".format(name))
+    print("case, seconds, peak KB, cache refs, cache misses,{}".format(" speedup, efficiency," if name in SCALING else ""))
+    single = {} # t=1 time of each case
+    for label, command in SUITES[name]:
+        runs = [run_once( command ) for _ in range(repeats)]
+        seconds = min( r[0] for r in runs )
+        peak = max( r[1] for r in runs )
+        perf = run_perf( command ) or {}
+        scaling = ""
+        if name in SCALING:
+            case, threads = label.rsplit(" t=",1)
+            single.setdefault( case, seconds )
+            speedup = single[case] / seconds
+            scaling = " {:.2f}, {:.2f},".format( speedup, speedup / int(threads) )
+        print("{}, {:.3f}, {}, {}, {},{}".format(
+            label, seconds, peak,
+            perf.get("cache-references","n/a"),
+            perf.get("cache-misses","n/a"),
+            scaling ) )
+    print()
+
+def CommandLine():
+    """Setup argparser object to process the command line"""
+    cl = argparse.ArgumentParser(description="Time the distance programs.\n 2021 by Paul H Alfille\nsee http://github.com/alfille/distance")
+    cl.add_argument("suite",help="Suite(s) to run: {} (default all)".format(", ".join(SUITES)),nargs='*',default=[])
+    cl.add_argument("-n","--repeats",help="Runs of each case (best time is shown)",type=int,default=3)
+    return cl.parse_args()
+
+if __name__ == '__main__': # command line
+    args = CommandLine() # Get args from command line
+    for suite in ( args.suite or list(SUITES) ):
+        if suite not in SUITES:
+            print("Unknown suite {} -- choose from {}".format(suite,", ".join(SUITES)))
+            continue
+        run_suite( suite, args.repeats )
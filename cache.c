@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+void cache_engine( char * engine, size_t size, int separable, int batch, int stream, int kernel )
+{
+    if ( ! separable ) {
+        snprintf( engine, size, "points" ) ;
+        return ;
+    }
+    if ( batch ) {
+        snprintf( engine, size, "batch%d%s", batch, kernel ? "-kernel" : "" ) ;
+    } else {
+        snprintf( engine, size, "%s%s", stream ? "stream" : "prefix", kernel ? "-kernel" : "" ) ;
+    }
+}
+
+void cache_key( struct cache_entry * ce, const char * kind, int powers, const double * values, int exact, const char * precision, const char * rng, unsigned long seed, const char * engine, const char * domain )
+{
+    memset( ce, 0, sizeof( struct cache_entry ) ) ;
+    snprintf( ce->kind, sizeof( ce->kind ), "%s", kind ) ;
+    snprintf( ce->domain, sizeof( ce->domain ), "%s", domain ) ;
+    ce->exact = exact ;
+    ce->powers = powers ;
+    ce->values = malloc( powers * sizeof( double ) ) ;
+    memcpy( ce->values, values, powers * sizeof( double ) ) ;
+
+    // canonical text -- powers with full precision so 2.5 and 2.50 match
+    // (the cube is left out of the key so older cube results still match)
+    int len = snprintf( ce->key, CACHE_KEY_MAX, "kind=%s exact=%d precision=%s rng=%s seed=%lu engine=%s ", kind, exact, precision, rng, seed, engine ) ;
+    if ( strcmp( domain, "cube" ) != 0 ) {
+        len += snprintf( ce->key + len, CACHE_KEY_MAX - len, "domain=%s ", domain ) ;
+    }
+    len += snprintf( ce->key + len, CACHE_KEY_MAX - len, "powers=" ) ;
+    for ( int ip = 0 ; ip < powers && len < CACHE_KEY_MAX ; ++ip ) {
+        len += snprintf( ce->key + len, CACHE_KEY_MAX - len, "%s%.17g", ip ? "," : "", values[ip] ) ;
+    }
+}
+
+// file name from a hash (FNV-1a) of the key
+static void cache_path( const char * dir, const struct cache_entry * ce, char * path, size_t size )
+{
+    uint64_t hash = 14695981039346656037ULL ;
+    for ( const char * c = ce->key ; *c ; ++c ) {
+        hash ^= (unsigned char) *c ;
+        hash *= 1099511628211ULL ;
+    }
+    snprintf( path, size, "%s/%s-%016llx.cache", dir, ce->kind, (unsigned long long) hash ) ;
+}
+
+int cache_read( const char * path, struct cache_entry * ce )
+{
+    FILE * f = fopen( path, "rb" ) ;
+    if ( f == NULL ) {
+        return 1 ;
+    }
+
+    char magic[8] ;
+    int32_t version, keylen, head[3] ;
+    int64_t counts[2] ;
+    if ( fread( magic, 1, 8, f ) != 8 || memcmp( magic, CACHE_MAGIC, 8 ) != 0
+      || fread( &version, sizeof( version ), 1, f ) != 1 || version != CACHE_VERSION
+      || fread( &keylen, sizeof( keylen ), 1, f ) != 1 || keylen < 0 || keylen >= CACHE_KEY_MAX
+      || fread( ce->key, 1, keylen, f ) != (size_t) keylen
+      || fread( head, sizeof( int32_t ), 3, f ) != 3
+      || fread( counts, sizeof( int64_t ), 2, f ) != 2
+      || head[1] < 0 || head[2] < 1 ) {
+        fclose( f ) ;
+        return 1 ;
+    }
+    ce->key[keylen] = '\0' ;
+    sscanf( ce->key, "kind=%31s", ce->kind ) ;
+    const char * domain = strstr( ce->key, " domain=" ) ;
+    if ( domain == NULL || sscanf( domain, " domain=%15s", ce->domain ) != 1 ) {
+        strcpy( ce->domain, "cube" ) ;
+    }
+    ce->exact = head[0] ;
+    ce->dimensions = head[1] ;
+    ce->powers = head[2] ;
+    ce->samples = counts[0] ;
+    ce->segments = counts[1] ;
+
+    size_t cells = (size_t) ( ce->dimensions + 1 ) * ce->powers ;
+    ce->values = malloc( ce->powers * sizeof( double ) ) ;
+    ce->totals = malloc( cells * sizeof( double ) ) ;
+    int bad = fread( ce->values, sizeof( double ), ce->powers, f ) != (size_t) ce->powers
+           || fread( ce->totals, sizeof( double ), cells, f ) != cells ;
+    fclose( f ) ;
+    if ( bad ) {
+        cache_free( ce ) ;
+        return 1 ;
+    }
+    return 0 ;
+}
+
+int cache_load( const char * dir, struct cache_entry * ce )
+{
+    char path[4096] ;
+    cache_path( dir, ce, path, sizeof( path ) ) ;
+
+    struct cache_entry found ;
+    memset( &found, 0, sizeof( found ) ) ;
+    if ( cache_read( path, &found ) != 0 ) {
+        return 1 ;
+    }
+    // guard against a hash collision
+    if ( strcmp( found.key, ce->key ) != 0 ) {
+        cache_free( &found ) ;
+        return 1 ;
+    }
+    free( ce->values ) ;
+    *ce = found ;
+    return 0 ;
+}
+
+long cache_fetch( const char * dir, struct cache_entry * ce, int dimensions, long samples, double * totals )
+{
+    if ( cache_load( dir, ce ) != 0 ) {
+        return 0 ;
+    }
+    // More dimensions than asked for are fine if there are already enough samples
+    // (rows are independent of later dimensions), but can't be extended
+    if ( ce->dimensions < dimensions || ( ce->dimensions > dimensions && ce->samples < samples ) ) {
+        ce->segments = 0 ;
+        return 0 ;
+    }
+    memcpy( totals, ce->totals, (size_t) ( dimensions + 1 ) * ce->powers * sizeof( double ) ) ;
+    return ce->samples ;
+}
+
+int cache_save( const char * dir, const struct cache_entry * ce, int dimensions, long samples, long segments, const double * totals )
+{
+    if ( mkdir( dir, 0777 ) != 0 && errno != EEXIST ) {
+        fprintf( stderr, "Cannot make cache directory %s\n", dir ) ;
+        return 1 ;
+    }
+
+    // write a temporary file and rename it so readers never see half a file
+    char path[4096] ;
+    char temp[4096+32] ;
+    cache_path( dir, ce, path, sizeof( path ) ) ;
+
+    // an entry with more dimensions (and too few samples to serve this run)
+    // isn't replaced -- its higher dimensions would be lost
+    struct cache_entry old ;
+    memset( &old, 0, sizeof( old ) ) ;
+    if ( cache_read( path, &old ) == 0 ) {
+        int bigger = ( strcmp( old.key, ce->key ) == 0 && old.dimensions > dimensions ) ;
+        cache_free( &old ) ;
+        if ( bigger ) {
+            fprintf( stderr, "Cache file %s has %d dimensions -- not replaced (-d %d extends it)\n", path, old.dimensions, old.dimensions ) ;
+            return 1 ;
+        }
+    }
+    snprintf( temp, sizeof( temp ), "%s.%ld", path, (long) getpid() ) ;
+    FILE * f = fopen( temp, "wb" ) ;
+    if ( f == NULL ) {
+        fprintf( stderr, "Cannot write cache file %s\n", temp ) ;
+        return 1 ;
+    }
+
+    int32_t version = CACHE_VERSION ;
+    int32_t keylen = strlen( ce->key ) ;
+    int32_t head[3] = { ce->exact, dimensions, ce->powers } ;
+    int64_t counts[2] = { samples, segments } ;
+    size_t cells = (size_t) ( dimensions + 1 ) * ce->powers ;
+    int bad = fwrite( CACHE_MAGIC, 1, 8, f ) != 8
+           || fwrite( &version, sizeof( version ), 1, f ) != 1
+           || fwrite( &keylen, sizeof( keylen ), 1, f ) != 1
+           || fwrite( ce->key, 1, keylen, f ) != (size_t) keylen
+           || fwrite( head, sizeof( int32_t ), 3, f ) != 3
+           || fwrite( counts, sizeof( int64_t ), 2, f ) != 2
+           || fwrite( ce->values, sizeof( double ), ce->powers, f ) != (size_t) ce->powers
+           || fwrite( totals, sizeof( double ), cells, f ) != cells ;
+    bad = ( fclose( f ) != 0 ) || bad ;
+    if ( bad || rename( temp, path ) != 0 ) {
+        fprintf( stderr, "Cannot write cache file %s\n", path ) ;
+        unlink( temp ) ;
+        return 1 ;
+    }
+    return 0 ;
+}
+
+void cache_free( struct cache_entry * ce )
+{
+    free( ce->values ) ;
+    free( ce->totals ) ;
+    ce->values = NULL ;
+    ce->totals = NULL ;
+}
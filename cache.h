@@ -0,0 +1,68 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// On-disk cache of Monte Carlo totals so identical runs aren't repeated.
+//
+// One file per key (program, powers, exact dimensions, precision, RNG, seed,
+// engine, domain) in the cache directory. The engines draw the random numbers
+// in different orders, so a seed only repeats its samples through the same
+// engine. The file holds the raw totals (sum over samples of each length) and
+// the sample count, so a later run asking for more samples only draws the
+// difference and adds it in.
+//
+// File layout (native byte order):
+//   char   magic[8]      "DISTCACH"
+//   int32  version
+//   int32  key length, then the key text (no terminating null)
+//   int32  exact dimensions, dimensions, powers
+//   int64  samples, segments (sampling runs merged)
+//   double powers[powers]
+//   double totals[dimensions+1][powers]
+
+#include <stddef.h>
+
+#define CACHE_MAGIC "DISTCACH"
+#define CACHE_VERSION 1
+#define CACHE_KEY_MAX 8192
+
+struct cache_entry {
+    char key[CACHE_KEY_MAX] ;
+    char kind[32] ; // program name
+    char domain[16] ; // where the points come from (cube if the key doesn't say)
+    int exact ; // dimensions done by integration (no totals)
+    int dimensions ;
+    int powers ;
+    long samples ;
+    long segments ;
+    double * values ; // the powers
+    double * totals ; // (dimensions+1) x powers, filled by cache_read
+} ;
+
+// Name of the sampling engine for the key: points (non-separable domains),
+// batchN, stream or prefix, with -kernel for the specialized kernels
+void cache_engine( char * engine, size_t size, int separable, int batch, int stream, int kernel ) ;
+
+// Fill in the key fields of a new entry
+void cache_key( struct cache_entry * ce, const char * kind, int powers, const double * values, int exact, const char * precision, const char * rng, unsigned long seed, const char * engine, const char * domain ) ;
+
+// Read a cache file by name -- 0 on success
+int cache_read( const char * path, struct cache_entry * ce ) ;
+
+// Find the entry for ce->key in the directory -- 0 on success
+int cache_load( const char * dir, struct cache_entry * ce ) ;
+
+// Copy the cached totals usable for this run into totals ((dimensions+1) x powers)
+// returns the samples already in them (0 if none, then ce->segments is 0 too)
+long cache_fetch( const char * dir, struct cache_entry * ce, int dimensions, long samples, double * totals ) ;
+
+// Write (replace) the entry for ce->key with these totals -- 0 on success
+// (an entry with more dimensions is left alone)
+int cache_save( const char * dir, const struct cache_entry * ce, int dimensions, long samples, long segments, const double * totals ) ;
+
+void cache_free( struct cache_entry * ce ) ;
+
+#endif /* CACHE_H */
@@ -0,0 +1,72 @@
+#ifndef DDOUBLE_H
+#define DDOUBLE_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Double-double arithmetic: an unevaluated sum hi+lo of two doubles,
+// about 32 digits. Only what the --validate reference needs.
+// Error-free sums (Knuth two-sum) and products (fma).
+
+#include <math.h>
+
+struct ddouble {
+    double hi ;
+    double lo ;
+} ;
+
+static inline struct ddouble dd_make( double hi, double lo )
+{
+    // renormalize so |lo| is below half an ulp of hi
+    double s = hi + lo ;
+    struct ddouble r = { s, lo - ( s - hi ) } ;
+    return r ;
+}
+
+static inline struct ddouble dd_add( struct ddouble x, struct ddouble y )
+{
+    double s = x.hi + y.hi ;
+    double b = s - x.hi ;
+    double e = ( x.hi - ( s - b ) ) + ( y.hi - b ) ;
+    return dd_make( s, e + x.lo + y.lo ) ;
+}
+
+static inline struct ddouble dd_mul( struct ddouble x, struct ddouble y )
+{
+    double p = x.hi * y.hi ;
+    double e = fma( x.hi, y.hi, -p ) ;
+    return dd_make( p, e + x.hi * y.lo + x.lo * y.hi ) ;
+}
+
+// a/b of two doubles
+static inline struct ddouble dd_div( double a, double b )
+{
+    double q = a / b ;
+    return dd_make( q, fma( -q, b, a ) / b ) ;
+}
+
+// pth root: double pow for a start, then one Newton step in double-double
+// (quadratic convergence -- 16 correct digits become 32)
+static inline struct ddouble dd_root( struct ddouble x, int p )
+{
+    struct ddouble y = { pow( x.hi, 1./p ), 0. } ;
+    if ( p == 1 || y.hi == 0. ) {
+        return ( p == 1 ) ? x : y ;
+    }
+    struct ddouble raised = { 1., 0. } ; // y^(p-1) by squaring
+    struct ddouble square = y ;
+    for ( int n = p - 1 ; n > 0 ; n >>= 1 ) {
+        if ( n & 1 ) {
+            raised = dd_mul( raised, square ) ;
+        }
+        square = dd_mul( square, square ) ;
+    }
+    struct ddouble power = dd_mul( raised, y ) ; // y^p
+    struct ddouble residual = dd_add( power, dd_make( -x.hi, -x.lo ) ) ;
+    // the correction is tiny, double is enough for it
+    double step = residual.hi / ( p * raised.hi ) ;
+    return dd_add( y, dd_make( -step, 0. ) ) ;
+}
+
+#endif /* DDOUBLE_H */
@@ -3,6 +3,16 @@
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <getopt.h>
+
+#include "exact.h"
+#include "batch.h"
+#include "cache.h"
+#include "moments.h"
+#include "domain.h"
+#include "kernel.h"
+#include "kernels.h"
+#include "ddouble.h"
 
 void help( void )
 {
@@ -24,23 +34,539 @@ void help( void )
     printf("\t-p 3\tmax power (metric)\n");
     printf("\t-r 1000000\trandom points each measure\n");
     printf("\t-n\tnormalize (to longest diagonal)\n");
+    printf("\t-e 4\t--exact-low-d 4 dimensions up to 4 by numerical integration (no random points)\n");
+    printf("\t-s\tstream -- running sums only, memory O(powers) rather than O(dimensions*powers)\n");
+    printf("\t-b 0\tbatch -- samples per batch, 0 sizes the batch to the cache\n");
+    printf("\t--precision fp64\tfp64, mixed (float sums, double totals) or fp32 (all float)\n");
+    printf("\t\treduced precision reports its deviation from fp64 for each entry on stderr\n");
+    printf("\t--domain cube\tcube, torus, gaussian, ball, sphere or simplex -- where the points are\n");
+    printf("\t\t-n normalizes to the longest segment in the domain\n");
+    printf("\t-w axes.txt\tper-axis extents (side lengths or weights) from a file, one number per axis\n");
+    printf("\t\tfor cube, torus and gaussian -- -n normalizes to the box's diagonal\n");
+    printf("\t--validate 10000\trun 10000 samples through the chosen path and in double-double (cube, torus)\n");
+    printf("\t\tto report each entry's rounding bias next to its Monte Carlo standard error (stderr)\n");
+    printf("\t--generic\tno specialized kernels -- always the loops sized at run time\n");
+    printf("\t-M\tmoments -- variance, skew and excess kurtosis column groups after the means\n");
+    printf("\t-S 42\t--seed 42 random seed (default from the clock)\n");
+    printf("\t-C dir\t--cache dir keep results in dir -- a repeated run is read back,\n");
+    printf("\t\tone with more samples only draws the extra samples\n");
     printf("\t-h\tthis help\n");
     exit(0) ;
 }
 
+// Sample random segments keeping a row of sums for every dimension,
+// then take the roots in a second pass over all the rows.
+void sample_prefix( int Dimensions, int Powers, long Randoms, int Exact, enum domain Domain, const double * extent, double totals[Dimensions+1][Powers], struct moments * mom )
+{
+    int d,p;
+
+    // zero out the first row (i.e. zero dimensional case) of the sums
+    double sums[Dimensions+1][Powers];
+    for (p=0; p<Powers; ++p) {
+        sums[0][p] = 0.;
+    }
+
+    // Generate and add up sums of coordinate differences at various dimensions
+    // from two randomly generated points in the hypercube.
+    for (long r = 0; r < Randoms; ++r) {
+        // fill in the sum of powers for a single sample at various dimensions
+        // and powers.
+        for (d=1; d <= Dimensions; ++d) {
+            // For each dimension, get 2 coordinates in this dimension.
+            // we only care about dx, the delta in the coordinate
+            // use abs value for odd powers calculation
+            double dx = domain_dx( Domain ) * extent[d-1];
+
+            // for each power, the sum will be the entry from the row above
+            // plus dx raised to that power.
+            double cumprod = 1;
+            for (p=0; p<Powers; ++p) {
+                cumprod *= dx;
+                sums[d][p] = sums[d-1][p] + cumprod;
+            }
+        }
+
+        // Add the pth root of each sum to the totals
+        // (low dimensions done exactly are skipped)
+        for (d=Exact+1; d <= Dimensions; ++d) {
+            for (p=0; p<Powers; ++p) {
+                double length = pow(sums[d][p], 1./(p+1));
+                totals[d][p] += length;
+                if (mom) {
+                    moments_add( mom, d*Powers+p, length ) ;
+                }
+            }
+        }
+    }
+}
+
+// Sample random segments keeping only one running sum per power.
+// Each dimension's sum is rooted and added to the totals as soon as it is
+// made, so memory is O(Powers) rather than O(Dimensions*Powers).
+void sample_stream( int Dimensions, int Powers, long Randoms, int Exact, enum domain Domain, const double * extent, double totals[Dimensions+1][Powers], struct moments * mom )
+{
+    double running[Powers];
+    int d,p;
+
+    for (long r = 0; r < Randoms; ++r) {
+        // zero dimensional case
+        for (p=0; p<Powers; ++p) {
+            running[p] = 0.;
+        }
+
+        for (d=1; d <= Dimensions; ++d) {
+            double dx = domain_dx( Domain ) * extent[d-1];
+
+            // add dx^p to the running sum for each power
+            double cumprod = 1;
+            for (p=0; p<Powers; ++p) {
+                cumprod *= dx;
+                running[p] += cumprod;
+            }
+
+            // and the pth root of this dimension's sum to the totals
+            if (d > Exact) {
+                for (p=0; p<Powers; ++p) {
+                    double length = pow(running[p], 1./(p+1));
+                    totals[d][p] += length;
+                    if (mom) {
+                        moments_add( mom, d*Powers+p, length ) ;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Sample a batch of random segments at a time, dimension by dimension.
+// A tile of running sums (powers x batch) is updated for each dimension
+// and folded into that dimension's totals once per batch rather than
+// once per sample.
+BATCH_CLONES
+void sample_batch( int Dimensions, int Powers, long Randoms, int Exact, int Batch, enum domain Domain, const double * extent, double totals[Dimensions+1][Powers], struct moments * mom )
+{
+    double (*tile)[Batch] = malloc( Powers * sizeof( *tile ) ) ; // on the heap -- the powers have no limit
+    double dx[Batch];
+    double dx_raised[Batch];
+    double length[Batch];
+    int p;
+    int b;
+
+    for (long r = 0; r < Randoms; r += Batch) {
+        int size = ( Randoms - r < Batch ) ? (int) ( Randoms - r ) : Batch ;
+
+        // zero dimensional case
+        for (p=0; p<Powers; ++p) {
+            for (b=0; b<size; ++b) {
+                tile[p][b] = 0.;
+            }
+        }
+
+        for (int d=1; d <= Dimensions; ++d) {
+            domain_fill( Domain, size, dx );
+            for (b=0; b<size; ++b) {
+                dx[b] *= extent[d-1];
+            }
+
+            // dx^p for each power by repeated multiplication (vectorizes across the batch)
+            for (b=0; b<size; ++b) {
+                dx_raised[b] = 1.;
+            }
+            for (p=0; p<Powers; ++p) {
+                for (b=0; b<size; ++b) {
+                    dx_raised[b] *= dx[b];
+                    tile[p][b] += dx_raised[b];
+                }
+            }
+
+            // fold the root of each sample's sum into this dimension's totals
+            if (d > Exact) {
+                for (p=0; p<Powers; ++p) {
+                    double sum = 0.;
+                    for (b=0; b<size; ++b) {
+                        length[b] = pow(tile[p][b], 1./(p+1));
+                        sum += length[b];
+                    }
+                    totals[d][p] += sum;
+                    if (mom) {
+                        for (b=0; b<size; ++b) {
+                            moments_add( mom, d*Powers+p, length[b] ) ;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    free( tile ) ;
+}
+
+// Reduced precision version of sample_batch:
+// float dx and running sums (twice the vector lanes, half the memory)
+// with totals in double (mixed) or compensated float (fp32).
+// Every SHADOW_EVERY'th batch is also done in double from the same dx;
+// deviation[d][p] gets the relative difference over those batches.
+BATCH_CLONES
+void sample_batch_float( int Dimensions, int Powers, long Randoms, int Exact, int Batch, enum domain Domain, const double * extent, enum precision Precision, double totals[Dimensions+1][Powers], double deviation[Dimensions+1][Powers] )
+{
+    float (*tile)[Batch] = malloc( Powers * sizeof( *tile ) ) ; // on the heap -- the powers have no limit
+    float dx[Batch];
+    float dx_raised[Batch];
+    double (*shadow)[Batch] = malloc( Powers * sizeof( *shadow ) ) ; // double precision reference
+    double dx_shadow[Batch];
+    double dx_shadow_raised[Batch];
+    int p;
+    int b;
+
+    // fp32 totals and their Kahan compensation
+    float ftotals[Dimensions+1][Powers];
+    float compensate[Dimensions+1][Powers];
+    // shadow batches: sums of (float - double) lengths and of double lengths
+    double difference[Dimensions+1][Powers];
+    double reference[Dimensions+1][Powers];
+    for (int d=0; d <= Dimensions; ++d) {
+        for (p=0; p<Powers; ++p) {
+            ftotals[d][p] = 0.;
+            compensate[d][p] = 0.;
+            difference[d][p] = 0.;
+            reference[d][p] = 0.;
+        }
+    }
+
+    for (long r = 0; r < Randoms; r += Batch) {
+        int size = ( Randoms - r < Batch ) ? (int) ( Randoms - r ) : Batch ;
+        int check = ( ( r / Batch ) % SHADOW_EVERY == 0 ) ;
+
+        // zero dimensional case
+        for (p=0; p<Powers; ++p) {
+            for (b=0; b<size; ++b) {
+                tile[p][b] = 0.;
+                shadow[p][b] = 0.;
+            }
+        }
+
+        for (int d=1; d <= Dimensions; ++d) {
+            domain_fill( Domain, size, dx_shadow );
+            for (b=0; b<size; ++b) {
+                dx_shadow[b] *= extent[d-1];
+                dx[b] = (float) dx_shadow[b];
+            }
+
+            // dx^p for each power by repeated multiplication (vectorizes across the batch)
+            for (b=0; b<size; ++b) {
+                dx_raised[b] = 1.;
+            }
+            for (p=0; p<Powers; ++p) {
+                for (b=0; b<size; ++b) {
+                    dx_raised[b] *= dx[b];
+                    tile[p][b] += dx_raised[b];
+                }
+            }
+            if (check) {
+                for (b=0; b<size; ++b) {
+                    dx_shadow_raised[b] = 1.;
+                }
+                for (p=0; p<Powers; ++p) {
+                    for (b=0; b<size; ++b) {
+                        dx_shadow_raised[b] *= dx_shadow[b];
+                        shadow[p][b] += dx_shadow_raised[b];
+                    }
+                }
+            }
+
+            // fold the root of each sample's sum into this dimension's totals
+            if (d > Exact) {
+                for (p=0; p<Powers; ++p) {
+                    float root = 1.f/(p+1);
+                    float sum = 0.;
+                    for (b=0; b<size; ++b) {
+                        sum += powf(tile[p][b], root);
+                    }
+                    if (Precision == PRECISION_FP32) {
+                        float y = sum - compensate[d][p];
+                        float t = ftotals[d][p] + y;
+                        compensate[d][p] = (t - ftotals[d][p]) - y;
+                        ftotals[d][p] = t;
+                    } else {
+                        totals[d][p] += sum;
+                    }
+                    if (check) {
+                        double shadow_sum = 0.;
+                        for (b=0; b<size; ++b) {
+                            shadow_sum += pow(shadow[p][b], 1./(p+1));
+                        }
+                        difference[d][p] += sum - shadow_sum;
+                        reference[d][p] += shadow_sum;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int d=1; d <= Dimensions; ++d) {
+        for (p=0; p<Powers; ++p) {
+            if (Precision == PRECISION_FP32) {
+                totals[d][p] += (double) ftotals[d][p] - compensate[d][p];
+            }
+            deviation[d][p] = ( reference[d][p] > 0. ) ? difference[d][p] / reference[d][p] : 0. ;
+        }
+    }
+    free( tile ) ;
+    free( shadow ) ;
+}
+
+// Sample random segments between points of a non-separable domain (ball, sphere, simplex).
+// The points change with the dimension, so every dimension sums all its
+// coordinate differences afresh -- O(Dimensions^2) per sample.
+void sample_points( int Dimensions, int Powers, long Randoms, enum domain Domain, double totals[Dimensions+1][Powers], struct moments * mom )
+{
+    double x[Dimensions], y[Dimensions];
+    double xscale[Dimensions+1], yscale[Dimensions+1];
+    double sums[Powers];
+    int d,p;
+
+    for (long r = 0; r < Randoms; ++r) {
+        domain_points( Domain, Dimensions, x, y, xscale, yscale );
+
+        for (d=1; d <= Dimensions; ++d) {
+            for (p=0; p<Powers; ++p) {
+                sums[p] = 0.;
+            }
+            // the first d coordinates at this dimension's scale
+            for (int i=0; i<d; ++i) {
+                double dx = fabs( x[i]*xscale[d] - y[i]*yscale[d] );
+                double cumprod = 1;
+                for (p=0; p<Powers; ++p) {
+                    cumprod *= dx;
+                    sums[p] += cumprod;
+                }
+            }
+            for (p=0; p<Powers; ++p) {
+                double length = pow(sums[p], 1./(p+1));
+                totals[d][p] += length;
+                if (mom) {
+                    moments_add( mom, d*Powers+p, length ) ;
+                }
+            }
+        }
+    }
+}
+
+// Same random segments as the fp64 engines (same seed, same order of random numbers)
+// in double-double, for --validate. Batch 0 draws a sample at a time like
+// sample_prefix and sample_stream, otherwise a dimension of a batch at a time.
+// totals and squares (of the lengths, for the standard error) are added to.
+void sample_reference( int Dimensions, int Powers, long Randoms, int Exact, int Batch, enum domain Domain, const double * extent, struct ddouble totals[Dimensions+1][Powers], double squares[Dimensions+1][Powers] )
+{
+    int chunk = Batch ? Batch : 1 ;
+    double (*dx)[Dimensions] = malloc( chunk * sizeof( *dx ) ) ; // dx[sample][dimension]
+    double column[chunk];
+    struct ddouble running[Powers];
+
+    for (long r = 0; r < Randoms; r += chunk) {
+        int size = ( Randoms - r < chunk ) ? (int) ( Randoms - r ) : chunk ;
+        for (int d=1; d <= Dimensions; ++d) {
+            if (Batch) {
+                domain_fill( Domain, size, column );
+                for (int b=0; b<size; ++b) {
+                    dx[b][d-1] = column[b] * extent[d-1];
+                }
+            } else {
+                dx[0][d-1] = domain_dx( Domain ) * extent[d-1];
+            }
+        }
+
+        for (int b=0; b<size; ++b) {
+            // sums of (dx/largest)^p -- the largest term is 1, so unlike
+            // dx^p nothing that matters underflows at high powers
+            double largest = 0.;
+            for (int p=0; p<Powers; ++p) {
+                running[p] = dd_make( 0., 0. );
+            }
+            for (int d=1; d <= Dimensions; ++d) {
+                double x = dx[b][d-1];
+                if (x > largest) {
+                    // rescale the sums to the new largest
+                    struct ddouble ratio = dd_div( largest, x );
+                    struct ddouble scale = ratio;
+                    for (int p=0; p<Powers; ++p) {
+                        running[p] = dd_mul( running[p], scale );
+                        scale = dd_mul( scale, ratio );
+                    }
+                    largest = x;
+                }
+                if (largest > 0.) {
+                    struct ddouble q = dd_div( x, largest );
+                    struct ddouble raised = q;
+                    for (int p=0; p<Powers; ++p) {
+                        running[p] = dd_add( running[p], raised );
+                        raised = dd_mul( raised, q );
+                    }
+                }
+                if (d > Exact) {
+                    for (int p=0; p<Powers; ++p) {
+                        struct ddouble length = dd_mul( dd_make( largest, 0. ), dd_root( running[p], p+1 ) );
+                        totals[d][p] = dd_add( totals[d][p], length );
+                        squares[d][p] += length.hi * length.hi;
+                    }
+                }
+            }
+        }
+    }
+    free( dx ) ;
+}
+
+// Specialized kernel for this many powers and batch tile (0 for prefix and stream)
+// NULL if none was built -- use the generic loops
+static const struct kernel * kernel_find( int Powers, int Batch )
+{
+    for (const struct kernel * k = kernels; k->powers; ++k) {
+        if (k->powers == Powers && k->batch == Batch) {
+            return k ;
+        }
+    }
+    return NULL ;
+}
+
+// Largest specialized batch tile for this many powers no bigger than Batch (0 if none)
+static int kernel_tile( int Powers, int Batch )
+{
+    int tile = 0 ;
+    for (const struct kernel * k = kernels; k->powers; ++k) {
+        if (k->powers == Powers && k->batch <= Batch && k->batch > tile) {
+            tile = k->batch ;
+        }
+    }
+    return tile ;
+}
+
+// Run the engine the options chose
+// (deviation is only filled in reduced precision)
+static void sample_engine( int Dimensions, int Powers, long Randoms, int Exact, int Batch, int Stream, enum precision Precision, const struct kernel * kernel, enum domain Domain, const double * extent, double totals[Dimensions+1][Powers], double (*deviation)[Powers], struct moments * mom )
+{
+    if (!domain_separable( Domain )) {
+        sample_points( Dimensions, Powers, Randoms, Domain, totals, mom ) ;
+    } else if (Precision != PRECISION_FP64) {
+        sample_batch_float( Dimensions, Powers, Randoms, Exact, Batch, Domain, extent, Precision, totals, deviation ) ;
+    } else if (Batch) {
+        if (kernel) {
+            kernel->batched( Dimensions, Randoms, Exact, Domain, extent, &totals[0][0], mom ) ;
+        } else {
+            sample_batch( Dimensions, Powers, Randoms, Exact, Batch, Domain, extent, totals, mom ) ;
+        }
+    } else if (Stream) {
+        if (kernel) {
+            kernel->stream( Dimensions, Randoms, Exact, Domain, extent, &totals[0][0], mom ) ;
+        } else {
+            sample_stream( Dimensions, Powers, Randoms, Exact, Domain, extent, totals, mom ) ;
+        }
+    } else {
+        if (kernel) {
+            kernel->prefix( Dimensions, Randoms, Exact, Domain, extent, &totals[0][0], mom ) ;
+        } else {
+            sample_prefix( Dimensions, Powers, Randoms, Exact, Domain, extent, totals, mom ) ;
+        }
+    }
+}
+
+// --validate: Samples segments from Seed through the chosen engine and again in
+// double-double, then print on stderr for each entry the rounding bias (engine
+// minus reference, relative) and the Monte Carlo standard error of a Randoms
+// sample run (relative, from the reference lengths) -- bias well below the
+// standard error means this precision is good enough.
+static void validate( int Dimensions, int Powers, long Randoms, long Samples, unsigned long Seed, int Exact, int Batch, int Stream, enum precision Precision, const struct kernel * kernel, enum domain Domain, const double * extent )
+{
+    double (*fast)[Powers] = calloc( Dimensions+1, sizeof( *fast ) ) ;
+    double (*deviation)[Powers] = calloc( Dimensions+1, sizeof( *deviation ) ) ;
+    struct ddouble (*reference)[Powers] = calloc( Dimensions+1, sizeof( *reference ) ) ;
+    double (*squares)[Powers] = calloc( Dimensions+1, sizeof( *squares ) ) ;
+
+    srand( Seed ) ;
+    sample_engine( Dimensions, Powers, Samples, Exact, Batch, Stream, Precision, kernel, Domain, extent, fast, deviation, NULL ) ;
+    srand( Seed ) ;
+    sample_reference( Dimensions, Powers, Samples, Exact, ( Batch || Precision != PRECISION_FP64 ) ? Batch : 0, Domain, extent, reference, squares ) ;
+
+    int cells = 0 ;
+    int rounded = 0 ; // entries where rounding bias is over a tenth of the standard error
+    double worst = 0. ; // largest bias / standard error
+    int worst_d = 0, worst_p = 0 ;
+    fprintf(stderr, "Validation %ld samples, %s -- rounding bias (relative)\n", Samples, precision_name( Precision ));
+    fprintf(stderr, "DIM\\Power, ");
+    for (int p=1; p<=Powers; ++p) {
+        fprintf(stderr, "%d, ", p);
+    }
+    for (int p=1; p<=Powers; ++p) {
+        fprintf(stderr, "stderr %d, ", p);
+    }
+    fprintf(stderr, "\n");
+    for (int d=Exact+1; d <= Dimensions; ++d) {
+        fprintf(stderr, "%d, ", d);
+        double bias[Powers] ;
+        for (int p=0; p<Powers; ++p) {
+            // difference first, in double-double, then scaled
+            struct ddouble diff = dd_add( dd_make( fast[d][p], 0. ), dd_make( -reference[d][p].hi, -reference[d][p].lo ) ) ;
+            bias[p] = diff.hi / reference[d][p].hi ;
+            fprintf(stderr, "%.3g, ", bias[p]);
+        }
+        for (int p=0; p<Powers; ++p) {
+            double mean = reference[d][p].hi / Samples ;
+            double variance = squares[d][p] / Samples - mean * mean ;
+            double error = sqrt( fmax( variance, 0. ) / Randoms ) / mean ;
+            fprintf(stderr, "%.3g, ", error);
+            ++cells ;
+            if (fabs( bias[p] ) > .1 * error) {
+                ++rounded ;
+            }
+            if (error > 0. && fabs( bias[p] ) / error > worst) {
+                worst = fabs( bias[p] ) / error ;
+                worst_d = d ;
+                worst_p = p+1 ;
+            }
+        }
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, "%d of %d entries have rounding bias over a tenth of the standard error", rounded, cells);
+    if (worst_d) {
+        fprintf(stderr, " -- worst bias/stderr %.3g at d=%d p=%d", worst, worst_d, worst_p);
+    }
+    fprintf(stderr, "\n");
+
+    free( fast ) ;
+    free( deviation ) ;
+    free( reference ) ;
+    free( squares ) ;
+}
+
 int main( int argc, char **argv )
 {
     int Dimensions = 100 ;
     int Powers = 3 ;
     long Randoms = 1000000 ;
     int Normalize = 0;
-
-    double scale = 1.0 / RAND_MAX ;
-
+    int Exact = 0; // dimensions done by integration rather than random points
+    int Batch = 0; // samples per batch (0 for one at a time)
+    int Moments = 0; // -M variance, skew, kurtosis too
+    unsigned long Seed = 0; // 0 for seeded from the clock
+    const char * Cache = NULL; // cache directory
+    int Stream = 0; // running sums only (no Dimensions x Powers sums table)
+    enum precision Precision = PRECISION_FP64 ;
+    enum domain Domain = DOMAIN_CUBE ;
+    const char * ExtentFile = NULL; // -w per-axis extents
+    int Generic = 0; // --generic no specialized kernels
+    long Validate = 0; // --validate samples compared with double-double
 
     // Arguments
+    static struct option long_options[] = {
+        { "exact-low-d", required_argument, 0, 'e' },
+        { "seed", required_argument, 0, 'S' },
+        { "cache", required_argument, 0, 'C' },
+        { "precision", required_argument, 0, 'P' },
+        { "domain", required_argument, 0, 'D' },
+        { "generic", no_argument, 0, 'G' },
+        { "validate", required_argument, 0, 'V' },
+        { 0, 0, 0, 0 }
+    } ;
     int c;
-    while ( (c = getopt( argc, argv, "hd:p:r:n" )) != -1 ) {
+    while ( (c = getopt_long( argc, argv, "hd:p:r:ne:sb:S:C:Mw:", long_options, NULL )) != -1 ) {
         switch ( c ) {
         case 'h':
             help() ;
@@ -66,13 +592,62 @@ int main( int argc, char **argv )
         case 'n':
             Normalize = 1 ;
             break ;
+        case 's':
+            Stream = 1 ;
+            break ;
+        case 'b':
+            Batch = atoi(optarg);
+            if (Batch<1) {
+                Batch = -1 ; // size to cache
+            } else if (Batch>BATCH_MAX) {
+                Batch = BATCH_MAX ;
+            }
+            break ;
+        case 'e':
+            Exact = atoi(optarg);
+            if (Exact<0) {
+                Exact = 0 ;
+            }
+            break ;
+        case 'S':
+            Seed = strtoul(optarg, NULL, 0);
+            break ;
+        case 'C':
+            Cache = optarg ;
+            break ;
+        case 'M':
+            Moments = 1 ;
+            break ;
+        case 'P':
+            if ( precision_parse( optarg ) < 0 ) {
+                fprintf(stderr, "Unknown precision %s -- fp32, mixed or fp64\n", optarg);
+                exit(1);
+            }
+            Precision = precision_parse( optarg ) ;
+            break ;
+        case 'D':
+            if ( domain_parse( optarg ) < 0 ) {
+                fprintf(stderr, "Unknown domain %s -- cube, torus, gaussian, ball, sphere or simplex\n", optarg);
+                exit(1);
+            }
+            Domain = domain_parse( optarg ) ;
+            break ;
+        case 'w':
+            ExtentFile = optarg ;
+            break ;
+        case 'G':
+            Generic = 1 ;
+            break ;
+        case 'V':
+            Validate = atol(optarg);
+            if (Validate<0) {
+                Validate = 0 ;
+            }
+            break ;
         }
     }
 
 
-    // Initialize random seed
-    srand(time(0));
-
     // Initialize totals to zero
     double totals[Dimensions+1][Powers];
     int d,p;
@@ -82,39 +657,126 @@ int main( int argc, char **argv )
         }
     }
 
-    // zero out the first row (i.e. zero dimensional case) of the sums
-    double sums[Dimensions+1][Powers];
+    // the powers as numbers
+    double values[Powers];
     for (p=0; p<Powers; ++p) {
-        sums[0][p] = 0.;
+        values[p] = p+1. ;
     }
 
-    // Generate and add up sums of coordinate differences at various dimensions
-    // from two randomly generated points in the hypercube.
-    for (long r = 0; r < Randoms; ++r) {
-        // fill in the sum of powers for a single sample at various dimensions
-        // and powers.
-        for (d=1; d <= Dimensions; ++d) {
-            // For each dimension, get 2 coordinates in this dimension.
-            // we only care about dx, the delta in the coordinate
-            // use abs value for odd powers calculation
-            double dx, dx_cumprod;
-            dx = fabs((rand() - rand()) * scale);
+    // Only the cube has exact low dimensions and only separable domains are batched
+    if (Domain != DOMAIN_CUBE && Exact) {
+        fprintf(stderr, "Exact low dimensions are for the cube only -- -e ignored\n");
+        Exact = 0 ;
+    }
+    if (!domain_separable( Domain )) {
+        if (Precision != PRECISION_FP64) {
+            fprintf(stderr, "Domain %s is only made in fp64 -- --precision ignored\n", domain_name( Domain ));
+            Precision = PRECISION_FP64 ;
+        }
+        if (Batch || Stream) {
+            fprintf(stderr, "Domain %s is sampled a point pair at a time -- -s and -b ignored\n", domain_name( Domain ));
+            Batch = Stream = 0 ;
+        }
+    }
 
-            // for each power, the sum will be the entry from the row above
-            // plus dx raised to that power.
-            double cumprod = 1;
-            for (p=0; p<Powers; ++p) {
-                cumprod *= dx;
-                sums[d][p] = sums[d-1][p] + cumprod;
+    // The reference draws its own random numbers -- uniform domains only
+    if (Validate && Domain != DOMAIN_CUBE && Domain != DOMAIN_TORUS) {
+        fprintf(stderr, "Validation is for cube and torus only -- --validate ignored\n");
+        Validate = 0 ;
+    }
+
+    // Per-axis extents (all 1 for the unit cube)
+    double * extent = NULL ;
+    if (ExtentFile) {
+        if (!domain_separable( Domain )) {
+            fprintf(stderr, "Extents are for cube, torus and gaussian -- -w ignored\n");
+            ExtentFile = NULL ;
+        } else {
+            extent = domain_extents( ExtentFile, Dimensions ) ;
+            if (extent == NULL) {
+                exit(1);
             }
+            if (Exact) {
+                fprintf(stderr, "Exact low dimensions are for the unit cube only -- -e ignored\n");
+                Exact = 0 ;
+            }
+            if (Cache) {
+                fprintf(stderr, "Extents are not cached -- -C ignored\n");
+                Cache = NULL ;
+            }
+        }
+    }
+    if (extent == NULL) {
+        extent = malloc( Dimensions * sizeof( double ) ) ;
+        for (int i=0; i<Dimensions; ++i) {
+            extent[i] = 1. ;
         }
+    }
 
-        // Add the pth root of each sum to the totals
-        for (d=1; d <= Dimensions; ++d) {
-            for (p=0; p<Powers; ++p) {
-                totals[d][p] += pow(sums[d][p], 1./(p+1));
-            }
+    // Longest segment for each dimension and power (for -n)
+    double (*diagonal)[Powers] = malloc( (Dimensions+1) * sizeof( *diagonal ) ) ;
+    domain_diagonals( Domain, Dimensions, Powers, values, ExtentFile ? extent : NULL, &diagonal[0][0], NULL ) ;
+
+    // Higher moments of the length in each cell
+    struct moments * mom = NULL ;
+    if (Moments) {
+        if (Precision != PRECISION_FP64) {
+            fprintf(stderr, "Moments are only made in fp64 -- --precision ignored\n");
+            Precision = PRECISION_FP64 ;
+        }
+        if (Cache) {
+            fprintf(stderr, "Moments are not cached -- -C ignored\n");
+            Cache = NULL ;
         }
+        mom = moments_init( (Dimensions+1)*Powers ) ;
+    }
+
+    // Generate the random segments
+    // (reduced precision is only done in batches)
+    double deviation[Precision == PRECISION_FP64 ? 1 : Dimensions+1][Powers];
+    if (Batch == 0 && Precision != PRECISION_FP64) {
+        Batch = -1 ;
+    }
+    if (Batch < 0) {
+        Batch = batch_autosize( Powers ) ;
+        // round down to a specialized tile if there is one
+        if (!Generic && Precision == PRECISION_FP64 && kernel_tile( Powers, Batch ) > 0) {
+            Batch = kernel_tile( Powers, Batch ) ;
+        }
+    }
+    // fixed-size kernel for these powers (and tile) if one was built
+    const struct kernel * kernel = Generic ? NULL : kernel_find( Powers, Batch ) ;
+
+    // Start from earlier results of the same run (and engine) if cached
+    long Cached = 0; // samples already in the totals
+    struct cache_entry entry ;
+    if (Cache) {
+        char engine[32] ;
+        cache_engine( engine, sizeof( engine ), domain_separable( Domain ), Batch, Stream, kernel != NULL && Precision == PRECISION_FP64 ) ;
+        cache_key( &entry, "distance", Powers, values, Exact, precision_name( Precision ), "rand", Seed, engine, domain_name( Domain ) ) ;
+        Cached = cache_fetch( Cache, &entry, Dimensions, Randoms, &totals[0][0] ) ;
+    }
+    long Draw = ( Randoms > Cached ) ? Randoms - Cached : 0 ; // new samples needed
+    if (Randoms < Cached) {
+        Randoms = Cached ; // use all the samples there are
+    }
+
+    // Rounding against double-double on separate samples first
+    if (Validate) {
+        validate( Dimensions, Powers, Randoms, Validate, Seed ? Seed : (unsigned long) time(0), Exact, Batch, Stream, Precision, kernel, Domain, extent ) ;
+    }
+
+    // Initialize random seed
+    // (each extension of a cached result continues with the next seed)
+    srand( Seed ? Seed + ( Cache ? entry.segments : 0 ) : (unsigned long) time(0) );
+
+    sample_engine( Dimensions, Powers, Draw, Exact, Batch, Stream, Precision, kernel, Domain, extent, totals, deviation, mom ) ;
+
+    if (Cache) {
+        if (Draw > 0) {
+            cache_save( Cache, &entry, Dimensions, Randoms, entry.segments+1, &totals[0][0] ) ;
+        }
+        cache_free( &entry ) ;
     }
 
     // Title line
@@ -122,6 +784,17 @@ int main( int argc, char **argv )
     for (p=1;p<=Powers;++p) {
         printf("%d, ",p);
     }
+    if (mom) {
+        for (p=1;p<=Powers;++p) {
+            printf("var %d, ",p);
+        }
+        for (p=1;p<=Powers;++p) {
+            printf("skew %d, ",p);
+        }
+        for (p=1;p<=Powers;++p) {
+            printf("kurt %d, ",p);
+        }
+    }
     printf("\n");
 
     // Loop though dimensions
@@ -131,18 +804,61 @@ int main( int argc, char **argv )
 
         // Print out the distances
         for (p=0;p<Powers;++p) {
-            if (Normalize) {
+            if (d <= Exact) {
+                // numerical integration -- show the extra digits
+                double length = exact_length( d, p+1. ) ;
+                if (Normalize) {
+                    length /= pow(d,1/(1.+p));
+                }
+                printf("%.15g, ", length);
+            } else if (Normalize) {
                 // note p is 0-indexed in C, but 1-indexed for calculation
-                printf("%g, ", totals[d][p]/Randoms/pow(d,1/(1.+p)));
+                printf("%g, ", totals[d][p]/Randoms/diagonal[d][p]);
             } else {
                 printf("%g, ", totals[d][p]/Randoms);
             }
         }
+
+        // moment column groups (variance scales with the square of the length)
+        if (mom) {
+            for (p=0;p<Powers;++p) {
+                double scale = Normalize ? diagonal[d][p] : 1. ;
+                printf("%g, ", moments_variance( mom, d*Powers+p )/(scale*scale));
+            }
+            for (p=0;p<Powers;++p) {
+                printf("%g, ", moments_skew( mom, d*Powers+p ));
+            }
+            for (p=0;p<Powers;++p) {
+                printf("%g, ", moments_kurtosis( mom, d*Powers+p ));
+            }
+        }
         // finish line
         printf("\n");
     }
 
+    // Deviation of reduced precision from double, same table layout on stderr
+    if (Precision != PRECISION_FP64 && Draw > 0) {
+        fprintf(stderr, "Deviation from fp64 (relative)\n");
+        fprintf(stderr, "DIM\\Power, ");
+        for (p=1;p<=Powers;++p) {
+            fprintf(stderr, "%d, ",p);
+        }
+        fprintf(stderr, "\n");
+        for (d=Exact+1; d <= Dimensions; ++d) {
+            fprintf(stderr, "%d, ",d);
+            for (p=0;p<Powers;++p) {
+                fprintf(stderr, "%.3g, ", deviation[d][p]);
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+
     // success
+    free( extent ) ;
+    free( diagonal ) ;
+    if (mom) {
+        moments_free( mom ) ;
+    }
     return 0 ;
 }
 
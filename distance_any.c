@@ -4,6 +4,16 @@
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <getopt.h>
+
+#include "rangelist.h"
+#include "exact.h"
+#include "batch.h"
+#include "cache.h"
+#include "moments.h"
+#include "histogram.h"
+#include "domain.h"
+#include "family.h"
 
 void help( void )
 {
@@ -28,126 +38,604 @@ void help( void )
     printf("\t-p \"1-20\"\tmetric power -- range 1 to 20\n");
     printf("\t-p \"1-20_3\"\tmetric power -- range with increment\n");
     printf("\t-p \".5,.75,2.5\"\tmetric power -- floats allowed\n");
+    printf("\t-p \"1,2,inf\"\tinf is L-infinity (Chebyshev), the largest |x1-x2|\n");
+    printf("\t\tpowers below %g are summed stably and printed best with -n\n", SMALL_P);
+    printf("\t-k canberra,angular\tother distances as extra columns\n");
+    printf("\t\tcanberra sum(|x1-x2|/(|x1|+|x2|)), angular the angle (radians) between the points from the origin\n");
     printf("\t-r 1000000\trandom points each measure\n");
     printf("\t-n\tnormalize (to longest diagonal)\n");
+    printf("\t-e 4\t--exact-low-d 4 dimensions up to 4 by numerical integration (no random points)\n");
+    printf("\t-s\tstream -- running sums only, memory O(powers) rather than O(dimensions*powers)\n");
+    printf("\t-b 0\tbatch -- samples per batch, 0 sizes the batch to the cache\n");
+    printf("\t--precision fp64\tfp64, mixed (float sums, double totals) or fp32 (all float)\n");
+    printf("\t\treduced precision reports its deviation from fp64 for each entry on stderr\n");
+    printf("\t-Q .05,.5,.95\tquantiles -- a table for each after the means\n");
+    printf("\t\tfrom the samples, so left empty for the -e dimensions\n");
+    printf("\t-H hist.csv\thistogram of each dimension and power to file (DIM,Power,low,high,count)\n");
+    printf("\t--bins 64\thistogram bins for -Q and -H (range from a %d sample pilot run)\n", HISTOGRAM_PILOT);
+    printf("\t--domain cube\tcube, torus, gaussian, ball, sphere or simplex -- where the points are\n");
+    printf("\t\t-n normalizes to the longest segment in the domain\n");
+    printf("\t-w axes.txt\tper-axis extents (side lengths or weights) from a file, one number per axis\n");
+    printf("\t\tfor cube, torus and gaussian -- -n normalizes to the box's diagonal\n");
+    printf("\t-M\tmoments -- variance, skew and excess kurtosis column groups after the means\n");
+    printf("\t-I 3\tmulti-norm -- also the integer powers 1 to 3 table (as distance -p 3)\n");
+    printf("\t-F \".5,2\"\tmulti-norm -- also the f-norm table for these powers (as distance_f -p)\n");
+    printf("\t\tevery table from the same random segments in one pass, each after an empty line\n");
+    printf("\t-S 42\t--seed 42 random seed (default from the clock)\n");
+    printf("\t-C dir\t--cache dir keep results in dir -- a repeated run is read back,\n");
+    printf("\t\tone with more samples only draws the extra samples\n");
     printf("\t-h\tthis help\n");
     exit(0) ;
 }
 
-struct rangelist {
-    int size ;
-    int alloc ;
-    double * val ;
-} ;
+// Sample random segments keeping a row of running values for every dimension,
+// then turn them into lengths in a second pass over all the rows.
+void sample_prefix( int Dimensions, struct rangelist * powerlist, long Randoms, int Exact, enum domain Domain, const double * extent, double totals[Dimensions+1][powerlist->size], struct histogram * hist, struct moments * mom )
+{
+    int Powers = powerlist->size ;
+    enum family family[Powers];
+    for (int ip=0; ip<Powers; ++ip) {
+        family[ip] = family_of( powerlist->val[ip] );
+    }
+    int coords = family_coords( Powers, powerlist->val );
 
-struct rangelist * rangelist_init( void ) {
-    struct rangelist * rl = malloc( sizeof ( struct rangelist ) ) ;
-    rl->alloc = 100 ;
-    rl->size = 0 ;
-    rl->val = malloc( rl->alloc * sizeof( double ) ) ;
-    return rl ;
+    // zero out the first row (i.e. zero dimensional case) of the sums
+    // (plus each point's sum of squares for the angle)
+    double sums[Dimensions+1][Powers];
+    double xx[Dimensions+1], yy[Dimensions+1];
+    for (int ip=0; ip<Powers; ++ip) {
+        sums[0][ip] = 0.;
+    }
+    xx[0] = yy[0] = 0.;
+
+    // Generate and add up sums of coordinate differences at various dimensions
+    // from two randomly generated points in the hypercube.
+    for (long r = 0; r < Randoms; ++r) {
+        // fill in the sum of powers for a single sample at various dimensions
+        // and powers.
+        for (int d=1; d <= Dimensions; ++d) {
+            // For each dimension, get 2 coordinates in this dimension.
+            // we only care about dx, the delta in the coordinate
+            // (unless canberra or angular want the coordinates too)
+            double dx, x = 0., y = 0.;
+            if (coords) {
+                domain_coords( Domain, 1, &x, &y, &dx );
+                x *= extent[d-1];
+                y *= extent[d-1];
+                dx *= extent[d-1];
+            } else {
+                dx = domain_dx( Domain ) * extent[d-1];
+            }
+            xx[d] = xx[d-1] + x*x;
+            yy[d] = yy[d-1] + y*y;
+
+            // for each power, the value will be the entry from the row above
+            // updated with this dimension
+            for (int ip=0; ip<Powers; ++ip) {
+                sums[d][ip] = family_add( family[ip], powerlist->val[ip], sums[d-1][ip], dx, x, y );
+            }
+        }
+
+        // Add the length of each to the totals
+        // (low dimensions done exactly are skipped)
+        for (int d=Exact+1; d <= Dimensions; ++d) {
+            for (int ip=0; ip<Powers; ++ip) {
+                double length = family_length( family[ip], powerlist->val[ip], sums[d][ip], d, xx[d], yy[d] );
+                totals[d][ip] += length;
+                if (hist) {
+                    histogram_add( hist, d*Powers+ip, length ) ;
+                }
+                if (mom) {
+                    moments_add( mom, d*Powers+ip, length ) ;
+                }
+            }
+        }
+    }
 }
 
-void rangelist_inc( struct rangelist * rl ) {
-    rl->alloc += 100 ;
-    rl->val = realloc( rl->val, rl->alloc * sizeof(double) ) ;
+// Sample random segments keeping only one running value per power.
+// Each dimension's value is turned into a length and added to the totals as
+// soon as it is made, so memory is O(powers) rather than O(Dimensions*powers).
+void sample_stream( int Dimensions, struct rangelist * powerlist, long Randoms, int Exact, enum domain Domain, const double * extent, double totals[Dimensions+1][powerlist->size], struct histogram * hist, struct moments * mom )
+{
+    int Powers = powerlist->size ;
+    enum family family[Powers];
+    for (int ip=0; ip<Powers; ++ip) {
+        family[ip] = family_of( powerlist->val[ip] );
+    }
+    int coords = family_coords( Powers, powerlist->val );
+    double running[Powers];
+
+    for (long r = 0; r < Randoms; ++r) {
+        // zero dimensional case
+        for (int ip=0; ip<Powers; ++ip) {
+            running[ip] = 0.;
+        }
+        double xx = 0., yy = 0.;
+
+        for (int d=1; d <= Dimensions; ++d) {
+            double dx, x = 0., y = 0.;
+            if (coords) {
+                domain_coords( Domain, 1, &x, &y, &dx );
+                x *= extent[d-1];
+                y *= extent[d-1];
+                dx *= extent[d-1];
+            } else {
+                dx = domain_dx( Domain ) * extent[d-1];
+            }
+            xx += x*x;
+            yy += y*y;
+
+            // update the running value for each power
+            for (int ip=0; ip<Powers; ++ip) {
+                running[ip] = family_add( family[ip], powerlist->val[ip], running[ip], dx, x, y );
+            }
+
+            // and this dimension's lengths to the totals
+            if (d > Exact) {
+                for (int ip=0; ip<Powers; ++ip) {
+                    double length = family_length( family[ip], powerlist->val[ip], running[ip], d, xx, yy );
+                    totals[d][ip] += length;
+                    if (hist) {
+                        histogram_add( hist, d*Powers+ip, length ) ;
+                    }
+                    if (mom) {
+                        moments_add( mom, d*Powers+ip, length ) ;
+                    }
+                }
+            }
+        }
+    }
 }
 
-void rangelist_add( double p, struct rangelist * rl ) {
-    if ( rl->size == rl->alloc ) {
-        rangelist_inc( rl ) ;
+// Sample a batch of random segments at a time, dimension by dimension.
+// A tile of running values (powers x batch) is updated for each dimension
+// and folded into that dimension's totals once per batch rather than
+// once per sample. The family is chosen once per power, outside the batch loops.
+BATCH_CLONES
+void sample_batch( int Dimensions, struct rangelist * powerlist, long Randoms, int Exact, int Batch, enum domain Domain, const double * extent, double totals[Dimensions+1][powerlist->size], struct histogram * hist, struct moments * mom )
+{
+    int Powers = powerlist->size ;
+    enum family family[Powers];
+    for (int ip=0; ip<Powers; ++ip) {
+        family[ip] = family_of( powerlist->val[ip] );
+    }
+    int coords = family_coords( Powers, powerlist->val );
+    double (*tile)[Batch] = malloc( Powers * sizeof( *tile ) ) ; // on the heap -- the powers have no limit
+    double dx[Batch];
+    double x[Batch], y[Batch]; // coordinates (canberra, angular)
+    double xx[Batch], yy[Batch]; // sums of squares (angular)
+    double length[Batch];
+    int b;
+
+    for (long r = 0; r < Randoms; r += Batch) {
+        int size = ( Randoms - r < Batch ) ? (int) ( Randoms - r ) : Batch ;
+
+        // zero dimensional case
+        for (int ip=0; ip<Powers; ++ip) {
+            for (b=0; b<size; ++b) {
+                tile[ip][b] = 0.;
+            }
+        }
+        for (b=0; b<size; ++b) {
+            xx[b] = yy[b] = 0.;
+        }
+
+        for (int d=1; d <= Dimensions; ++d) {
+            if (coords) {
+                domain_coords( Domain, size, x, y, dx );
+                for (b=0; b<size; ++b) {
+                    x[b] *= extent[d-1];
+                    y[b] *= extent[d-1];
+                    dx[b] *= extent[d-1];
+                    xx[b] += x[b]*x[b];
+                    yy[b] += y[b]*y[b];
+                }
+            } else {
+                domain_fill( Domain, size, dx );
+                for (b=0; b<size; ++b) {
+                    dx[b] *= extent[d-1];
+                }
+            }
+
+            // update the running values (vectorizes across the batch)
+            for (int ip=0; ip<Powers; ++ip) {
+                double p = powerlist->val[ip];
+                switch (family[ip]) {
+                case FAMILY_SMALL_P:
+                    for (b=0; b<size; ++b) {
+                        tile[ip][b] += expm1(p*log(dx[b]));
+                    }
+                    break;
+                case FAMILY_INF:
+                    for (b=0; b<size; ++b) {
+                        tile[ip][b] = fmax(tile[ip][b], dx[b]);
+                    }
+                    break;
+                case FAMILY_CANBERRA:
+                    for (b=0; b<size; ++b) {
+                        tile[ip][b] = family_add( FAMILY_CANBERRA, p, tile[ip][b], dx[b], x[b], y[b] );
+                    }
+                    break;
+                case FAMILY_ANGULAR:
+                    for (b=0; b<size; ++b) {
+                        tile[ip][b] += x[b]*y[b];
+                    }
+                    break;
+                default:
+                    for (b=0; b<size; ++b) {
+                        tile[ip][b] += pow(dx[b],p);
+                    }
+                    break;
+                }
+            }
+
+            // fold the length of each sample into this dimension's totals
+            if (d > Exact) {
+                for (int ip=0; ip<Powers; ++ip) {
+                    double sum = 0.;
+                    for (b=0; b<size; ++b) {
+                        length[b] = family_length( family[ip], powerlist->val[ip], tile[ip][b], d, xx[b], yy[b] );
+                        sum += length[b];
+                    }
+                    totals[d][ip] += sum;
+                    if (hist) {
+                        for (b=0; b<size; ++b) {
+                            histogram_add( hist, d*Powers+ip, length[b] ) ;
+                        }
+                    }
+                    if (mom) {
+                        for (b=0; b<size; ++b) {
+                            moments_add( mom, d*Powers+ip, length[b] ) ;
+                        }
+                    }
+                }
+            }
+        }
     }
-    rl->val[rl->size++] = p ;
+    free( tile ) ;
 }
 
-void rangelist_free( struct rangelist * rl ) {
-    free( rl ) ;
+// Reduced precision version of sample_batch:
+// float dx and running sums (twice the vector lanes, half the memory)
+// with totals in double (mixed) or compensated float (fp32).
+// Every SHADOW_EVERY'th batch is also done in double from the same dx;
+// deviation[d][ip] gets the relative difference over those batches.
+BATCH_CLONES
+void sample_batch_float( int Dimensions, struct rangelist * powerlist, long Randoms, int Exact, int Batch, enum domain Domain, const double * extent, enum precision Precision, double totals[Dimensions+1][powerlist->size], double deviation[Dimensions+1][powerlist->size] )
+{
+    int Powers = powerlist->size ;
+    float (*tile)[Batch] = malloc( Powers * sizeof( *tile ) ) ; // on the heap -- the powers have no limit
+    float dx[Batch];
+    double (*shadow)[Batch] = malloc( Powers * sizeof( *shadow ) ) ; // double precision reference
+    double dx_shadow[Batch];
+    int b;
+
+    // fp32 totals and their Kahan compensation
+    float ftotals[Dimensions+1][Powers];
+    float compensate[Dimensions+1][Powers];
+    // shadow batches: sums of (float - double) lengths and of double lengths
+    double difference[Dimensions+1][Powers];
+    double reference[Dimensions+1][Powers];
+    for (int d=0; d <= Dimensions; ++d) {
+        for (int ip=0; ip<Powers; ++ip) {
+            ftotals[d][ip] = 0.;
+            compensate[d][ip] = 0.;
+            difference[d][ip] = 0.;
+            reference[d][ip] = 0.;
+        }
+    }
+
+    for (long r = 0; r < Randoms; r += Batch) {
+        int size = ( Randoms - r < Batch ) ? (int) ( Randoms - r ) : Batch ;
+        int check = ( ( r / Batch ) % SHADOW_EVERY == 0 ) ;
+
+        // zero dimensional case
+        for (int ip=0; ip<Powers; ++ip) {
+            for (b=0; b<size; ++b) {
+                tile[ip][b] = 0.;
+                shadow[ip][b] = 0.;
+            }
+        }
+
+        for (int d=1; d <= Dimensions; ++d) {
+            domain_fill( Domain, size, dx_shadow );
+            for (b=0; b<size; ++b) {
+                dx_shadow[b] *= extent[d-1];
+                dx[b] = (float) dx_shadow[b];
+            }
+
+            // add dx^p to the running sums (vectorizes across the batch)
+            for (int ip=0; ip<Powers; ++ip) {
+                float power = (float) powerlist->val[ip];
+                for (b=0; b<size; ++b) {
+                    tile[ip][b] += powf(dx[b],power);
+                }
+                if (check) {
+                    for (b=0; b<size; ++b) {
+                        shadow[ip][b] += pow(dx_shadow[b],powerlist->val[ip]);
+                    }
+                }
+            }
+
+            // fold the root of each sample's sum into this dimension's totals
+            if (d > Exact) {
+                for (int ip=0; ip<Powers; ++ip) {
+                    float root = (float) ( 1./powerlist->val[ip] );
+                    float sum = 0.;
+                    for (b=0; b<size; ++b) {
+                        sum += powf(tile[ip][b], root);
+                    }
+                    if (Precision == PRECISION_FP32) {
+                        float y = sum - compensate[d][ip];
+                        float t = ftotals[d][ip] + y;
+                        compensate[d][ip] = (t - ftotals[d][ip]) - y;
+                        ftotals[d][ip] = t;
+                    } else {
+                        totals[d][ip] += sum;
+                    }
+                    if (check) {
+                        double shadow_sum = 0.;
+                        for (b=0; b<size; ++b) {
+                            shadow_sum += pow(shadow[ip][b], 1./powerlist->val[ip]);
+                        }
+                        difference[d][ip] += sum - shadow_sum;
+                        reference[d][ip] += shadow_sum;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int d=1; d <= Dimensions; ++d) {
+        for (int ip=0; ip<Powers; ++ip) {
+            if (Precision == PRECISION_FP32) {
+                totals[d][ip] += (double) ftotals[d][ip] - compensate[d][ip];
+            }
+            deviation[d][ip] = ( reference[d][ip] > 0. ) ? difference[d][ip] / reference[d][ip] : 0. ;
+        }
+    }
+    free( tile ) ;
+    free( shadow ) ;
+}
+
+// Multi-norm (-I, -F): the Lp table (-p), distance's integer power table and
+// distance_f's f-norm table from one pass over the random segments.
+// One stage makes each batch of dx, takes its log once, and adds dx^e to a
+// running sum for every distinct exponent e of the three lists -- 1..ints by
+// repeated multiplication, the others as exp(e*log dx). The tables' columns
+// are consumers of those sums: a length (the eth root) for Lp and integer
+// columns, the sum itself for the f-norm.
+struct multi {
+    int ints ; // exponents 1..ints, made by multiplication, come first
+    int exps ; // distinct exponents
+    double * exp ;
+    int outs ; // columns: Lp, then integer, then f-norm
+    int * source ; // exponent of each column
+    int * root ; // a length (1) or an f-norm sum (0)
+} ;
+
+static int multi_exponent( struct multi * m, double e )
+{
+    if ( e == floor( e ) && e >= 1. && e <= m->ints ) {
+        return (int) e - 1 ;
+    }
+    for ( int i = m->ints ; i < m->exps ; ++i ) {
+        if ( m->exp[i] == e ) {
+            return i ;
+        }
+    }
+    m->exp[m->exps] = e ;
+    return m->exps++ ;
+}
+
+static void multi_column( struct multi * m, double e, int root )
+{
+    m->source[m->outs] = multi_exponent( m, e ) ;
+    m->root[m->outs++] = root ;
 }
 
-void rangelist_print( struct rangelist * rl ) {
-    printf("Ranglist size=%d alloc=%d values= ",rl->size,rl->alloc);
-    for (int i = 0 ; i < rl->size ; ++i ) {
-        printf("%f ",rl->val[i]);
+struct multi * multi_init( struct rangelist * powerlist, int Ints, struct rangelist * flist )
+{
+    int columns = powerlist->size + Ints + ( flist ? flist->size : 0 ) ;
+    struct multi * m = malloc( sizeof( struct multi ) ) ;
+    m->ints = Ints ;
+    m->exps = Ints ;
+    m->exp = malloc( ( Ints + columns ) * sizeof( double ) ) ;
+    m->source = malloc( columns * sizeof( int ) ) ;
+    m->root = malloc( columns * sizeof( int ) ) ;
+    m->outs = 0 ;
+    for ( int i = 0 ; i < Ints ; ++i ) {
+        m->exp[i] = i + 1 ;
+    }
+    for ( int ip = 0 ; ip < powerlist->size ; ++ip ) {
+        multi_column( m, powerlist->val[ip], 1 ) ;
+    }
+    for ( int i = 0 ; i < Ints ; ++i ) {
+        multi_column( m, i + 1, 1 ) ;
     }
-    printf("\n") ;
+    for ( int ip = 0 ; flist && ip < flist->size ; ++ip ) {
+        multi_column( m, flist->val[ip], 0 ) ;
+    }
+    return m ;
 }
 
-struct rangelist * range( char * p_string )
+void multi_free( struct multi * m )
 {
-    // Interpret the string as a list of power values
-    // individual 1,2, 5
-    // ranges 1 _ 6
-
-    char * rcopy = strdup( p_string ) ;
-    //printf("Full %s\n",rcopy) ;
-
-    struct rangelist * rl = rangelist_init() ;
-    
-    char * rcomma ;
-    char * rthis = strtok_r( rcopy, ",", &rcomma ) ;
-
-    while ( rthis != NULL ) {
-        //printf("Comma %s\n",rthis);
-
-        char * rbar ;
-        char * rthat = strtok_r( rthis, "_", &rbar ) ;
-        double p_val[3] ; // extent of range
-        int p_num = 0 ; // range elements
-
-        while ( rthat != NULL ) {
-            //printf("\t Bar %s\n",rthat) ;
-            if ( p_num == 3 ) {
-                // only 3 entries in range allowed
-                break ;
+    free( m->exp ) ;
+    free( m->source ) ;
+    free( m->root ) ;
+    free( m ) ;
+}
+
+BATCH_CLONES
+void sample_multi( int Dimensions, struct multi * m, long Randoms, int Batch, enum domain Domain, const double * extent, double totals[Dimensions+1][m->outs] )
+{
+    int Exps = m->exps ;
+    int Ints = m->ints ;
+    double (*tile)[Batch] = malloc( Exps * sizeof( *tile ) ) ; // on the heap -- the powers have no limit
+    double dx[Batch];
+    double log_dx[Batch];
+    double dx_raised[Batch];
+    int b;
+
+    for (long r = 0; r < Randoms; r += Batch) {
+        int size = ( Randoms - r < Batch ) ? (int) ( Randoms - r ) : Batch ;
+
+        // zero dimensional case
+        for (int e=0; e<Exps; ++e) {
+            for (b=0; b<size; ++b) {
+                tile[e][b] = 0.;
+            }
+        }
+
+        for (int d=1; d <= Dimensions; ++d) {
+            // the shared stage: dx, one log, every exponent's running sum
+            domain_fill( Domain, size, dx );
+            for (b=0; b<size; ++b) {
+                dx[b] *= extent[d-1];
+                dx_raised[b] = 1.;
+            }
+            for (int e=0; e<Ints; ++e) {
+                for (b=0; b<size; ++b) {
+                    dx_raised[b] *= dx[b];
+                    tile[e][b] += dx_raised[b];
+                }
             }
-            double v = atof(rthat) ;
-            if (v <= 0.) {
-                v = 1. ;
+            if (Exps > Ints) {
+                for (b=0; b<size; ++b) {
+                    log_dx[b] = log(dx[b]);
+                }
+                for (int e=Ints; e<Exps; ++e) {
+                    double p = m->exp[e];
+                    for (b=0; b<size; ++b) {
+                        tile[e][b] += exp(p*log_dx[b]);
+                    }
+                }
             }
-            p_val[p_num++] = v ;
 
-            rthat = strtok_r( NULL, "_", &rbar ) ;
+            // the consumers: each column folds its exponent's sums into the totals
+            for (int o=0; o<m->outs; ++o) {
+                const double * run = tile[m->source[o]];
+                double p = m->exp[m->source[o]];
+                double sum = 0.;
+                if (!m->root[o] || p == 1.) {
+                    for (b=0; b<size; ++b) {
+                        sum += run[b];
+                    }
+                } else if (p == 2.) {
+                    for (b=0; b<size; ++b) {
+                        sum += sqrt(run[b]);
+                    }
+                } else {
+                    for (b=0; b<size; ++b) {
+                        sum += pow(run[b],1./p);
+                    }
+                }
+                totals[d][o] += sum;
+            }
         }
+    }
+    free( tile ) ;
+}
 
-        switch (p_num) {
-        case 0:
-            // no entries
-            break ;
-        case 1:
-            // single entry
-            p_val[1] = p_val[0] ;
-            // fall through ...
-        case 2:
-            // straight range
-            p_val[2] = 1 ;
-            // fall through ...
-        case 3:
-            for ( double v = p_val[0]; v <= p_val[1] ; v += p_val[2] ) {
-                rangelist_add( v, rl ) ;
+// Sample random segments between points of a non-separable domain (ball, sphere, simplex).
+// The points change with the dimension, so every dimension sums all its
+// coordinate differences afresh -- O(Dimensions^2) per sample.
+void sample_points( int Dimensions, struct rangelist * powerlist, long Randoms, enum domain Domain, double totals[Dimensions+1][powerlist->size], struct histogram * hist, struct moments * mom )
+{
+    int Powers = powerlist->size ;
+    enum family family[Powers];
+    for (int ip=0; ip<Powers; ++ip) {
+        family[ip] = family_of( powerlist->val[ip] );
+    }
+    double x[Dimensions], y[Dimensions];
+    double xscale[Dimensions+1], yscale[Dimensions+1];
+    double sums[Powers];
+
+    for (long r = 0; r < Randoms; ++r) {
+        domain_points( Domain, Dimensions, x, y, xscale, yscale );
+
+        for (int d=1; d <= Dimensions; ++d) {
+            for (int ip=0; ip<Powers; ++ip) {
+                sums[ip] = 0.;
+            }
+            double xx = 0., yy = 0.;
+            // the first d coordinates at this dimension's scale
+            for (int i=0; i<d; ++i) {
+                double xi = x[i]*xscale[d];
+                double yi = y[i]*yscale[d];
+                double dx = fabs( xi - yi );
+                xx += xi*xi;
+                yy += yi*yi;
+                for (int ip=0; ip<Powers; ++ip) {
+                    sums[ip] = family_add( family[ip], powerlist->val[ip], sums[ip], dx, xi, yi );
+                }
+            }
+            for (int ip=0; ip<Powers; ++ip) {
+                double length = family_length( family[ip], powerlist->val[ip], sums[ip], d, xx, yy );
+                totals[d][ip] += length;
+                if (hist) {
+                    histogram_add( hist, d*Powers+ip, length ) ;
+                }
+                if (mom) {
+                    moments_add( mom, d*Powers+ip, length ) ;
+                }
             }
         }
-
-        rthis = strtok_r( NULL, "," , &rcomma ) ;
     }
+}
 
-    free( rcopy ) ;
+// Longest possible length in the totals' units -- the top of a histogram
+// (gaussian lengths are unbounded, its canberra and angular are not)
+static double histogram_limit( enum domain Domain, double value, int d, double diagonal, double log_diagonal )
+{
+    switch ( family_of( value ) ) {
+    case FAMILY_CANBERRA:
+    case FAMILY_ANGULAR:
+        return diagonal ;
+    case FAMILY_SMALL_P:
+        return ( Domain == DOMAIN_GAUSSIAN ) ? HUGE_VAL : exp( log_diagonal - log( d ) / value ) ;
+    default:
+        return ( Domain == DOMAIN_GAUSSIAN ) ? HUGE_VAL : diagonal ;
+    }
+}
 
-    return rl ;
-} 
-     
 int main( int argc, char **argv )
 {
     int Dimensions = 100 ;
     long Randoms = 1000000 ;
     int Normalize = 0;
-
-    double scale = 1.0 / RAND_MAX ;
+    int Exact = 0; // dimensions done by integration rather than random points
+    int Batch = 0; // samples per batch (0 for one at a time)
+    int Moments = 0; // -M variance, skew, kurtosis too
+    unsigned long Seed = 0; // 0 for seeded from the clock
+    const char * Cache = NULL; // cache directory
+    int Stream = 0; // running sums only (no Dimensions x powers sums table)
+    enum precision Precision = PRECISION_FP64 ;
+    enum domain Domain = DOMAIN_CUBE ;
+    const char * ExtentFile = NULL; // -w per-axis extents
+    struct rangelist * quantiles = NULL ; // -Q
+    const char * HistFile = NULL ; // -H
+    int Bins = HISTOGRAM_BINS ;
 
     struct rangelist * powerlist = NULL ;
+    const char * Kinds = NULL ; // -k canberra,angular
+    int Ints = 0 ; // -I integer power table
+    struct rangelist * flist = NULL ; // -F f-norm table
 
     // Arguments
+    static struct option long_options[] = {
+        { "exact-low-d", required_argument, 0, 'e' },
+        { "seed", required_argument, 0, 'S' },
+        { "cache", required_argument, 0, 'C' },
+        { "precision", required_argument, 0, 'P' },
+        { "domain", required_argument, 0, 'D' },
+        { "bins", required_argument, 0, 'B' },
+        { 0, 0, 0, 0 }
+    } ;
     int c;
-    while ( (c = getopt( argc, argv, "hd:p:r:n" )) != -1 ) {
+    while ( (c = getopt_long( argc, argv, "hd:p:r:ne:sb:S:C:MQ:H:w:k:I:F:", long_options, NULL )) != -1 ) {
         switch ( c ) {
         case 'h':
             help() ;
@@ -170,6 +658,84 @@ int main( int argc, char **argv )
         case 'n':
             Normalize = 1 ;
             break ;
+        case 's':
+            Stream = 1 ;
+            break ;
+        case 'b':
+            Batch = atoi(optarg);
+            if (Batch<1) {
+                Batch = -1 ; // size to cache
+            } else if (Batch>BATCH_MAX) {
+                Batch = BATCH_MAX ;
+            }
+            break ;
+        case 'e':
+            Exact = atoi(optarg);
+            if (Exact<0) {
+                Exact = 0 ;
+            }
+            break ;
+        case 'S':
+            Seed = strtoul(optarg, NULL, 0);
+            break ;
+        case 'C':
+            Cache = optarg ;
+            break ;
+        case 'M':
+            Moments = 1 ;
+            break ;
+        case 'P':
+            if ( precision_parse( optarg ) < 0 ) {
+                fprintf(stderr, "Unknown precision %s -- fp32, mixed or fp64\n", optarg);
+                exit(1);
+            }
+            Precision = precision_parse( optarg ) ;
+            break ;
+        case 'D':
+            if ( domain_parse( optarg ) < 0 ) {
+                fprintf(stderr, "Unknown domain %s -- cube, torus, gaussian, ball, sphere or simplex\n", optarg);
+                exit(1);
+            }
+            Domain = domain_parse( optarg ) ;
+            break ;
+        case 'w':
+            ExtentFile = optarg ;
+            break ;
+        case 'k':
+            Kinds = optarg ;
+            break ;
+        case 'Q':
+            quantiles = rangelist_init() ;
+            for ( char * q = optarg ; *q ; ) {
+                char * end ;
+                double v = strtod( q, &end ) ;
+                if ( end == q ) {
+                    break ;
+                }
+                if ( v >= 0. && v <= 1. ) {
+                    rangelist_add( v, quantiles ) ;
+                }
+                q = ( *end == ',' ) ? end+1 : end ;
+            }
+            break ;
+        case 'H':
+            HistFile = optarg ;
+            break ;
+        case 'B':
+            Bins = atoi(optarg);
+            if (Bins<1) {
+                Bins = 1 ;
+            }
+            break ;
+        case 'I':
+            Ints = atoi(optarg);
+            if (Ints<1) {
+                Ints = 1 ;
+            }
+            break ;
+        case 'F':
+            flist = range( optarg ) ;
+            break ;
         }
     }
 
@@ -177,9 +743,45 @@ int main( int argc, char **argv )
         // default power range
         powerlist = range("1_3");
     }
+    // other distances ride along as stand-in power values
+    if ( Kinds ) {
+        char kinds[strlen( Kinds )+1] ;
+        strcpy( kinds, Kinds ) ;
+        for ( char * k = strtok( kinds, "," ) ; k ; k = strtok( NULL, "," ) ) {
+            double v = family_parse( k ) ;
+            if ( v == 0. ) {
+                fprintf(stderr, "Unknown distance %s -- canberra or angular\n", k);
+                exit(1);
+            }
+            rangelist_add( v, powerlist ) ;
+        }
+    }
 
-    // Initialize random seed
-    srand(time(0));
+    // Multi-norm: one pass of plain fp64 batches, only the means
+    struct multi * multi = NULL ;
+    if ( Ints || flist ) {
+        if (!family_plain( powerlist->size, powerlist->val ) || !domain_separable( Domain )) {
+            fprintf(stderr, "Multi-norm is for powers 0.1 and up in cube, torus and gaussian -- -I and -F ignored\n");
+        } else {
+            if (flist && rangelist_finite( flist ) > 0) {
+                fprintf(stderr, "The f-norm has no inf -- left out of -F\n");
+            }
+            if (Exact || Precision != PRECISION_FP64 || Cache || Moments || quantiles || HistFile || Stream) {
+                fprintf(stderr, "Multi-norm runs fp64 batches of means only -- -e, --precision, -C, -M, -Q, -H and -s ignored\n");
+                Exact = 0 ;
+                Precision = PRECISION_FP64 ;
+                Cache = NULL ;
+                Moments = 0 ;
+                if (quantiles) {
+                    rangelist_free( quantiles ) ;
+                    quantiles = NULL ;
+                }
+                HistFile = NULL ;
+                Stream = 0 ;
+            }
+            multi = multi_init( powerlist, Ints, ( flist && flist->size ) ? flist : NULL ) ;
+        }
+    }
 
     // Initialize totals to zero
     double totals[Dimensions+1][powerlist->size];
@@ -189,42 +791,220 @@ int main( int argc, char **argv )
         }
     }
 
-    // zero out the first row (i.e. zero dimensional case) of the sums
-    double sums[Dimensions+1][powerlist->size];
-    for (int ip=0; ip<powerlist->size; ++ip) {
-        sums[0][ip] = 0.;
+    // Exact low dimensions and reduced precision are for plain Lp powers only
+    if (!family_plain( powerlist->size, powerlist->val )) {
+        if (Exact) {
+            fprintf(stderr, "Exact low dimensions are for powers 0.1 and up only -- -e ignored\n");
+            Exact = 0 ;
+        }
+        if (Precision != PRECISION_FP64) {
+            fprintf(stderr, "Small p, inf, canberra and angular are only made in fp64 -- --precision ignored\n");
+            Precision = PRECISION_FP64 ;
+        }
     }
 
-    // Generate and add up sums of coordinate differences at various dimensions
-    // from two randomly generated points in the hypercube.
-    for (long r = 0; r < Randoms; ++r) {
-        // fill in the sum of powers for a single sample at various dimensions
-        // and powers.
-        for (int d=1; d <= Dimensions; ++d) {
-            // For each dimension, get 2 coordinates in this dimension.
-            // we only care about dx, the delta in the coordinate
-            // use abs value for odd powers calculation
-            double dx = fabs((rand() - rand()) * scale);
+    // Only the cube has exact low dimensions and only separable domains are batched
+    if (Domain != DOMAIN_CUBE && Exact) {
+        fprintf(stderr, "Exact low dimensions are for the cube only -- -e ignored\n");
+        Exact = 0 ;
+    }
+    if (!domain_separable( Domain )) {
+        if (Precision != PRECISION_FP64) {
+            fprintf(stderr, "Domain %s is only made in fp64 -- --precision ignored\n", domain_name( Domain ));
+            Precision = PRECISION_FP64 ;
+        }
+        if (Batch || Stream) {
+            fprintf(stderr, "Domain %s is sampled a point pair at a time -- -s and -b ignored\n", domain_name( Domain ));
+            Batch = Stream = 0 ;
+        }
+    }
 
-            // for each power, the sum will be the entry from the row above
-            // plus dx raised to that power.
-            for (int ip=0; ip<powerlist->size; ++ip) {
-                sums[d][ip] = sums[d-1][ip] + pow(dx,powerlist->val[ip]);
+    // Per-axis extents (all 1 for the unit cube)
+    double * extent = NULL ;
+    if (ExtentFile) {
+        if (!domain_separable( Domain )) {
+            fprintf(stderr, "Extents are for cube, torus and gaussian -- -w ignored\n");
+            ExtentFile = NULL ;
+        } else {
+            extent = domain_extents( ExtentFile, Dimensions ) ;
+            if (extent == NULL) {
+                exit(1);
+            }
+            if (Exact) {
+                fprintf(stderr, "Exact low dimensions are for the unit cube only -- -e ignored\n");
+                Exact = 0 ;
+            }
+            if (Cache) {
+                fprintf(stderr, "Extents are not cached -- -C ignored\n");
+                Cache = NULL ;
+            }
+        }
+    }
+    if (extent == NULL) {
+        extent = malloc( Dimensions * sizeof( double ) ) ;
+        for (int i=0; i<Dimensions; ++i) {
+            extent[i] = 1. ;
+        }
+    }
+
+    // Longest segment for each dimension and power (for -n)
+    // and the factor from a length in the totals to the printed value
+    // (small p totals are in units of d^(1/p) so the factor is done in logs)
+    double (*diagonal)[powerlist->size] = malloc( (Dimensions+1) * sizeof( *diagonal ) ) ;
+    double (*log_diagonal)[powerlist->size] = malloc( (Dimensions+1) * sizeof( *log_diagonal ) ) ;
+    double (*unit)[powerlist->size] = malloc( (Dimensions+1) * sizeof( *unit ) ) ;
+    domain_diagonals( Domain, Dimensions, powerlist->size, powerlist->val, ExtentFile ? extent : NULL, &diagonal[0][0], &log_diagonal[0][0] ) ;
+    for (int d=0; d <= Dimensions; ++d) {
+        for (int ip=0; ip<powerlist->size; ++ip) {
+            switch ( family_of( powerlist->val[ip] ) ) {
+            case FAMILY_CANBERRA:
+                // every coordinate adds at most 1
+                diagonal[d][ip] = d ;
+                break ;
+            case FAMILY_ANGULAR:
+                // right angle when all coordinates are positive
+                diagonal[d][ip] = ( Domain == DOMAIN_CUBE || Domain == DOMAIN_TORUS || Domain == DOMAIN_SIMPLEX ) ? M_PI_2 : M_PI ;
+                break ;
+            default:
+                break ;
+            }
+            if ( family_of( powerlist->val[ip] ) == FAMILY_SMALL_P ) {
+                unit[d][ip] = exp( log( d ) / powerlist->val[ip] - ( Normalize ? log_diagonal[d][ip] : 0. ) ) ;
+            } else {
+                unit[d][ip] = Normalize ? 1. / diagonal[d][ip] : 1. ;
             }
         }
+    }
+
+    // Distribution of lengths in each cell
+    struct histogram * hist = NULL ;
+    if (quantiles || HistFile) {
+        if (Precision != PRECISION_FP64) {
+            fprintf(stderr, "Histograms are only made in fp64 -- --precision ignored\n");
+            Precision = PRECISION_FP64 ;
+        }
+        if (Cache) {
+            fprintf(stderr, "Histograms are not cached -- -C ignored\n");
+            Cache = NULL ;
+        }
+        if (Exact) {
+            fprintf(stderr, "Dimensions up to %d are integrated, not sampled -- their quantiles are left empty\n", Exact);
+        }
+        hist = histogram_init( (Dimensions+1)*powerlist->size, Bins ) ;
+    }
 
-        // Add the pth root of each sum to the totals
+    // Higher moments of the length in each cell
+    struct moments * mom = NULL ;
+    if (Moments) {
+        if (Precision != PRECISION_FP64) {
+            fprintf(stderr, "Moments are only made in fp64 -- --precision ignored\n");
+            Precision = PRECISION_FP64 ;
+        }
+        if (Cache) {
+            fprintf(stderr, "Moments are not cached -- -C ignored\n");
+            Cache = NULL ;
+        }
+        mom = moments_init( (Dimensions+1)*powerlist->size ) ;
+    }
+
+    // Sampling engine -- reduced precision is only done in batches
+    double deviation[Precision == PRECISION_FP64 ? 1 : Dimensions+1][powerlist->size];
+    if (Batch == 0 && Precision != PRECISION_FP64) {
+        Batch = -1 ;
+    }
+    if (Batch <= 0 && multi) {
+        Batch = batch_autosize( multi->exps ) ;
+    }
+    if (Batch < 0) {
+        Batch = batch_autosize( powerlist->size ) ;
+    }
+
+    // Start from earlier results of the same run (and engine) if cached
+    long Cached = 0; // samples already in the totals
+    struct cache_entry entry ;
+    if (Cache) {
+        char engine[32] ;
+        cache_engine( engine, sizeof( engine ), domain_separable( Domain ), Batch, Stream, 0 ) ;
+        cache_key( &entry, "distance_any", powerlist->size, powerlist->val, Exact, precision_name( Precision ), "rand", Seed, engine, domain_name( Domain ) ) ;
+        Cached = cache_fetch( Cache, &entry, Dimensions, Randoms, &totals[0][0] ) ;
+    }
+    long Draw = ( Randoms > Cached ) ? Randoms - Cached : 0 ; // new samples needed
+    if (Randoms < Cached) {
+        Randoms = Cached ; // use all the samples there are
+    }
+
+    // Initialize random seed
+    // (each extension of a cached result continues with the next seed)
+    srand( Seed ? Seed + ( Cache ? entry.segments : 0 ) : (unsigned long) time(0) );
+
+    // Generate the random segments
+    if (hist) {
+        // pilot run (not counted) to set the histogram ranges
+        // lengths can't be longer than the diagonal (gaussian lengths are unbounded)
+        double (*pilot)[powerlist->size] = calloc( Dimensions+1, sizeof( *pilot ) ) ;
+        double (*limit)[powerlist->size] = calloc( Dimensions+1, sizeof( *limit ) ) ;
+        for (int d=1; d <= Dimensions; ++d) {
+            for (int ip=0; ip<powerlist->size; ++ip) {
+                limit[d][ip] = histogram_limit( Domain, powerlist->val[ip], d, diagonal[d][ip], log_diagonal[d][ip] ) ;
+            }
+        }
+        if (domain_separable( Domain )) {
+            sample_stream( Dimensions, powerlist, HISTOGRAM_PILOT, Exact, Domain, extent, pilot, hist, NULL ) ;
+        } else {
+            sample_points( Dimensions, powerlist, HISTOGRAM_PILOT, Domain, pilot, hist, NULL ) ;
+        }
+        histogram_range( hist, HISTOGRAM_PILOT, &limit[0][0] ) ;
+        free( pilot ) ;
+        free( limit ) ;
+    }
+    double (*multi_totals)[multi ? multi->outs : 1] = NULL ;
+    if (multi) {
+        multi_totals = calloc( Dimensions+1, sizeof( *multi_totals ) ) ;
+        sample_multi( Dimensions, multi, Draw, Batch, Domain, extent, multi_totals ) ;
+        // the Lp columns come first
         for (int d=1; d <= Dimensions; ++d) {
             for (int ip=0; ip<powerlist->size; ++ip) {
-                totals[d][ip] += pow(sums[d][ip], 1./powerlist->val[ip]);
+                totals[d][ip] = multi_totals[d][ip] ;
             }
         }
+    } else if (!domain_separable( Domain )) {
+        sample_points( Dimensions, powerlist, Draw, Domain, totals, hist, mom ) ;
+    } else if (Precision != PRECISION_FP64) {
+        sample_batch_float( Dimensions, powerlist, Draw, Exact, Batch, Domain, extent, Precision, totals, deviation ) ;
+    } else if (Batch) {
+        sample_batch( Dimensions, powerlist, Draw, Exact, Batch, Domain, extent, totals, hist, mom ) ;
+    } else if (Stream) {
+        sample_stream( Dimensions, powerlist, Draw, Exact, Domain, extent, totals, hist, mom ) ;
+    } else {
+        sample_prefix( Dimensions, powerlist, Draw, Exact, Domain, extent, totals, hist, mom ) ;
+    }
+
+    if (Cache) {
+        if (Draw > 0) {
+            cache_save( Cache, &entry, Dimensions, Randoms, entry.segments+1, &totals[0][0] ) ;
+        }
+        cache_free( &entry ) ;
     }
 
     // Title line
+    char label[powerlist->size][32];
+    for (int ip=0;ip<powerlist->size;++ip) {
+        family_label( label[ip], sizeof( label[ip] ), powerlist->val[ip] );
+    }
     printf("DIM\\Power, ");
     for (int ip=0;ip<powerlist->size;++ip) {
-        printf("%.2f, ",powerlist->val[ip]);
+        printf("%s, ",label[ip]);
+    }
+    if (mom) {
+        for (int ip=0;ip<powerlist->size;++ip) {
+            printf("var %s, ",label[ip]);
+        }
+        for (int ip=0;ip<powerlist->size;++ip) {
+            printf("skew %s, ",label[ip]);
+        }
+        for (int ip=0;ip<powerlist->size;++ip) {
+            printf("kurt %s, ",label[ip]);
+        }
     }
     printf("\n");
 
@@ -235,17 +1015,155 @@ int main( int argc, char **argv )
 
         // Print out the distances
         for (int ip=0;ip<powerlist->size;++ip) {
-            if (Normalize) {
-                printf("%g, ", totals[d][ip]/Randoms/pow(d,1/powerlist->val[ip]));
+            if (d <= Exact) {
+                // numerical integration -- show the extra digits
+                double length = exact_length( d, powerlist->val[ip] ) ;
+                if (Normalize) {
+                    length /= pow(d,1/powerlist->val[ip]);
+                }
+                printf("%.15g, ", length);
             } else {
-                printf("%g, ", totals[d][ip]/Randoms);
+                printf("%g, ", totals[d][ip]/Randoms*unit[d][ip]);
+            }
+        }
+
+        // moment column groups (variance scales with the square of the length)
+        if (mom) {
+            for (int ip=0;ip<powerlist->size;++ip) {
+                printf("%g, ", moments_variance( mom, d*powerlist->size+ip )*unit[d][ip]*unit[d][ip]);
+            }
+            for (int ip=0;ip<powerlist->size;++ip) {
+                printf("%g, ", moments_skew( mom, d*powerlist->size+ip ));
+            }
+            for (int ip=0;ip<powerlist->size;++ip) {
+                printf("%g, ", moments_kurtosis( mom, d*powerlist->size+ip ));
             }
         }
         // finish line
         printf("\n");
     }
 
+    // A table for each quantile, same layout
+    for (int iq=0; quantiles && iq<quantiles->size; ++iq) {
+        printf("\n");
+        printf("DIM\\Power q=%g, ", quantiles->val[iq]);
+        for (int ip=0;ip<powerlist->size;++ip) {
+            printf("%s, ",label[ip]);
+        }
+        printf("\n");
+        for (int d=1; d <= Dimensions; ++d) {
+            printf("%d, ",d);
+            for (int ip=0;ip<powerlist->size;++ip) {
+                if (d <= Exact) {
+                    // integrated, not sampled -- no distribution
+                    printf(", ");
+                    continue ;
+                }
+                double length = histogram_quantile( hist, d*powerlist->size+ip, quantiles->val[iq] ) ;
+                printf("%g, ", length*unit[d][ip]);
+            }
+            printf("\n");
+        }
+    }
+
+    // Multi-norm: the integer power and f-norm tables, same layout
+    if (multi) {
+        double (*multi_diagonal)[multi->exps] = malloc( (Dimensions+1) * sizeof( *multi_diagonal ) ) ;
+        domain_diagonals( Domain, Dimensions, multi->exps, multi->exp, ExtentFile ? extent : NULL, &multi_diagonal[0][0], NULL ) ;
+        if (Ints) {
+            printf("\n");
+            printf("DIM\\Power int, ");
+            for (int k=1; k<=Ints; ++k) {
+                printf("%d, ",k);
+            }
+            printf("\n");
+            for (int d=1; d <= Dimensions; ++d) {
+                printf("%d, ",d);
+                for (int o=powerlist->size; o<powerlist->size+Ints; ++o) {
+                    double scale = Normalize ? multi_diagonal[d][multi->source[o]] : 1. ;
+                    printf("%g, ", multi_totals[d][o]/Randoms/scale);
+                }
+                printf("\n");
+            }
+        }
+        if (multi->outs > powerlist->size+Ints) {
+            printf("\n");
+            printf("DIM\\Power f-norm, ");
+            for (int ip=0; ip<flist->size; ++ip) {
+                printf("%.2f, ",flist->val[ip]);
+            }
+            printf("\n");
+            for (int d=1; d <= Dimensions; ++d) {
+                printf("%d, ",d);
+                for (int o=powerlist->size+Ints; o<multi->outs; ++o) {
+                    double p = multi->exp[multi->source[o]] ;
+                    double scale = Normalize ? pow( multi_diagonal[d][multi->source[o]], p ) : 1. ;
+                    printf("%g, ", multi_totals[d][o]/Randoms/scale);
+                }
+                printf("\n");
+            }
+        }
+        free( multi_diagonal ) ;
+        free( multi_totals ) ;
+        multi_free( multi ) ;
+    }
+
+    // Histograms in long format (underflow and overflow bins included)
+    if (HistFile) {
+        FILE * hf = fopen( HistFile, "w" ) ;
+        if ( hf == NULL ) {
+            fprintf(stderr, "Cannot write %s\n", HistFile);
+        } else {
+            fprintf(hf, "DIM, Power, low, high, count, \n");
+            for (int d=Exact+1; d <= Dimensions; ++d) {
+                for (int ip=0;ip<powerlist->size;++ip) {
+                    int cell = d*powerlist->size+ip ;
+                    double longest = histogram_limit( Domain, powerlist->val[ip], d, diagonal[d][ip], log_diagonal[d][ip] ) ;
+                    for (int b=0; b < Bins+2; ++b) {
+                        double low = ( b == 0 ) ? 0. : histogram_edge( hist, cell, b ) ;
+                        double high = ( b == Bins+1 ) ? longest : histogram_edge( hist, cell, b+1 ) ;
+                        fprintf(hf, "%d, %s, %g, %g, %u, \n", d, label[ip], low*unit[d][ip], high*unit[d][ip], hist->count[cell*(Bins+2)+b]);
+                    }
+                }
+            }
+            fclose( hf ) ;
+        }
+    }
+
+    // Deviation of reduced precision from double, same table layout on stderr
+    if (Precision != PRECISION_FP64 && Draw > 0) {
+        fprintf(stderr, "Deviation from fp64 (relative)\n");
+        fprintf(stderr, "DIM\\Power, ");
+        for (int ip=0;ip<powerlist->size;++ip) {
+            fprintf(stderr, "%.2f, ",powerlist->val[ip]);
+        }
+        fprintf(stderr, "\n");
+        for (int d=Exact+1; d <= Dimensions; ++d) {
+            fprintf(stderr, "%d, ",d);
+            for (int ip=0;ip<powerlist->size;++ip) {
+                fprintf(stderr, "%.3g, ", deviation[d][ip]);
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+
     // success
+    free( extent ) ;
+    free( diagonal ) ;
+    free( log_diagonal ) ;
+    free( unit ) ;
+    if (mom) {
+        moments_free( mom ) ;
+    }
+    if (hist) {
+        histogram_free( hist ) ;
+    }
+    if (quantiles) {
+        rangelist_free( quantiles ) ;
+    }
+    if (flist) {
+        rangelist_free( flist ) ;
+    }
     rangelist_free( powerlist ) ;
     return 0 ;
 }
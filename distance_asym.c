@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "rangelist.h"
+
+void help( void )
+{
+    printf("distance_asym -- find the average distance between random points in\n") ;
+    printf("\ta unit N-cube in the limit of large dimension.\n");
+    printf("\n");
+    printf("By Paul H Alfille 2021 -- MIT license\n") ;
+    printf("\n");
+    printf("No random sampling is done. The sum of dx^p over the dimensions\n");
+    printf("is a sum of independent variables, so the central limit theorem\n");
+    printf("gives the normalized segment length as a series in 1/dimension\n");
+    printf("using the known moments of dx (density 2(1-x) on [0,1])\n");
+    printf("\t(E[dx^p])^(1/p)\tthe d->infinity limit (normalized)\n");
+    printf("\n");
+    printf("Output is CSV file format to make easy manipulation.\n");
+    printf("Syntax and output match distance_any\n");
+    printf("\n");
+    printf("Syntax:\n");
+    printf("\tdistance_asym [options]\n");
+    printf("Options:\n");
+    printf("\t-d 100\tmax dimensions\n");
+    printf("\t-p 20\tmetric power -- single\n");
+    printf("\t-p \"1-20\"\tmetric power -- range 1 to 20\n");
+    printf("\t-p \"1-20_3\"\tmetric power -- range with increment\n");
+    printf("\t-p \".5,.75,2.5\"\tmetric power -- floats allowed\n");
+    printf("\t-o 2\tcorrection order -- 0 limit only, 1 adds 1/d, 2 adds 1/d^2 terms\n");
+    printf("\t-n\tnormalize (to longest diagonal)\n");
+    printf("\t-h\tthis help\n");
+    printf("\n");
+    printf("The series is asymptotic: trust it when dimension >> power\n");
+    exit(0) ;
+}
+
+// Moments of a single dimension's contribution X = dx^p
+// dx has density 2(1-x) so E[X^k] = 2 / ((kp+1)(kp+2))
+double raw_moment( double p, int k )
+{
+    return 2. / ( (k*p+1.) * (k*p+2.) ) ;
+}
+
+// Series coefficients of the normalized length E[(S/d)^(1/p)] where S = sum of d X's
+//   coef[0] + coef[1]/d + coef[2]/d^2
+// Y=S/d has mean mu and central moments c2/d, c3/d^2, 3c2^2/d^2 + O(1/d^3)
+// so expand g(Y)=Y^(1/p) in a Taylor series about mu.
+void series( double p, double coef[3] )
+{
+    double a = 1. / p ;
+    double mu = raw_moment( p, 1 ) ;
+    double m2 = raw_moment( p, 2 ) ;
+    double m3 = raw_moment( p, 3 ) ;
+
+    // central moments of X
+    double c2 = m2 - mu*mu ;
+    double c3 = m3 - 3.*mu*m2 + 2.*mu*mu*mu ;
+
+    // derivatives of g at mu
+    double g0 = pow( mu, a ) ;
+    double g2 = a * (a-1.) * g0 / (mu*mu) ;
+    double g3 = g2 * (a-2.) / mu ;
+    double g4 = g3 * (a-3.) / mu ;
+
+    coef[0] = g0 ;
+    coef[1] = g2 * c2 / 2. ;
+    coef[2] = g3 * c3 / 6. + g4 * 3. * c2 * c2 / 24. ;
+}
+
+int main( int argc, char **argv )
+{
+    int Dimensions = 100 ;
+    int Order = 2 ;
+    int Normalize = 0;
+
+    struct rangelist * powerlist = NULL ;
+
+    // Arguments
+    int c;
+    while ( (c = getopt( argc, argv, "hd:p:o:n" )) != -1 ) {
+        switch ( c ) {
+        case 'h':
+            help() ;
+            break ;
+        case 'd':
+            Dimensions = atoi(optarg);
+            if (Dimensions<1) {
+                Dimensions = 1 ;
+            }
+            break ;
+        case 'p':
+            powerlist = range( optarg ) ;
+            break ;
+        case 'o':
+            Order = atoi(optarg);
+            if (Order<0) {
+                Order = 0 ;
+            } else if (Order>2) {
+                Order = 2 ;
+            }
+            break ;
+        case 'n':
+            Normalize = 1 ;
+            break ;
+        }
+    }
+
+    // inf (the max metric) is only in distance_any
+    if ( powerlist && rangelist_finite( powerlist ) > 0 ) {
+        fprintf(stderr, "inf is for distance_any only -- dropped\n");
+    }
+    if ( powerlist==NULL || powerlist->size==0 ) {
+        // default power range
+        if ( powerlist ) {
+            rangelist_free( powerlist ) ;
+        }
+        powerlist = range("1_3");
+    }
+
+    // Series coefficients only depend on power
+    double coef[powerlist->size][3];
+    for (int ip=0; ip<powerlist->size; ++ip) {
+        series( powerlist->val[ip], coef[ip] ) ;
+    }
+
+    // Title line
+    printf("DIM\\Power, ");
+    for (int ip=0;ip<powerlist->size;++ip) {
+        printf("%.2f, ",powerlist->val[ip]);
+    }
+    printf("\n");
+
+    // Loop though dimensions
+    for (int d=1; d <= Dimensions; ++d) {
+        // Start line with dimension
+        printf("%d, ",d);
+
+        // Sum the series (normalized) and print
+        for (int ip=0;ip<powerlist->size;++ip) {
+            double length = 0. ;
+            for (int o=Order; o>=0; --o) {
+                length = length / d + coef[ip][o] ;
+            }
+            if (Normalize) {
+                printf("%g, ", length);
+            } else {
+                printf("%g, ", length*pow(d,1/powerlist->val[ip]));
+            }
+        }
+        // finish line
+        printf("\n");
+    }
+
+    // success
+    rangelist_free( powerlist ) ;
+    return 0 ;
+}
@@ -4,6 +4,14 @@
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <getopt.h>
+
+#include "rangelist.h"
+#include "exact.h"
+#include "batch.h"
+#include "cache.h"
+#include "moments.h"
+#include "domain.h"
 
 void help( void )
 {
@@ -31,124 +39,210 @@ void help( void )
     printf("\t-p \".5,.75,2.5\"\tmetric power -- floats allowed\n");
     printf("\t-r 1000000\trandom points each measure\n");
     printf("\t-n\tnormalize (to longest diagonal)\n");
+    printf("\t-e 4\t--exact-low-d 4 dimensions up to 4 by numerical integration (no random points)\n");
+    printf("\t-s\tstream -- running sums only, memory O(powers) rather than O(dimensions*powers)\n");
+    printf("\t-b 0\tbatch -- samples per batch, 0 sizes the batch to the cache\n");
+    printf("\t--domain cube\tcube, torus, gaussian, ball, sphere or simplex -- where the points are\n");
+    printf("\t\t-n normalizes to the longest segment in the domain\n");
+    printf("\t-w axes.txt\tper-axis extents (side lengths or weights) from a file, one number per axis\n");
+    printf("\t\tfor cube, torus and gaussian -- -n normalizes to the box's diagonal\n");
+    printf("\t-M\tmoments -- variance, skew and excess kurtosis column groups after the means\n");
+    printf("\t-S 42\t--seed 42 random seed (default from the clock)\n");
+    printf("\t-C dir\t--cache dir keep results in dir -- a repeated run is read back,\n");
+    printf("\t\tone with more samples only draws the extra samples\n");
     printf("\t-h\tthis help\n");
     exit(0) ;
 }
 
-struct rangelist {
-    int size ;
-    int alloc ;
-    double * val ;
-} ;
-
-struct rangelist * rangelist_init( void ) {
-    struct rangelist * rl = malloc( sizeof ( struct rangelist ) ) ;
-    rl->alloc = 100 ;
-    rl->size = 0 ;
-    rl->val = malloc( rl->alloc * sizeof( double ) ) ;
-    return rl ;
-}
-
-void rangelist_inc( struct rangelist * rl ) {
-    rl->alloc += 100 ;
-    rl->val = realloc( rl->val, rl->alloc * sizeof(double) ) ;
-}
+// Sample random segments keeping a row of sums for every dimension,
+// then add them to the totals in a second pass over all the rows.
+void sample_prefix( int Dimensions, struct rangelist * powerlist, long Randoms, int Exact, enum domain Domain, const double * extent, double totals[Dimensions+1][powerlist->size], struct moments * mom )
+{
 
-void rangelist_add( double p, struct rangelist * rl ) {
-    if ( rl->size == rl->alloc ) {
-        rangelist_inc( rl ) ;
+    // zero out the first row (i.e. zero dimensional case) of the sums
+    double sums[Dimensions+1][powerlist->size];
+    for (int ip=0; ip<powerlist->size; ++ip) {
+        sums[0][ip] = 0.;
     }
-    rl->val[rl->size++] = p ;
-}
 
-void rangelist_free( struct rangelist * rl ) {
-    free( rl ) ;
-}
+    // Generate and add up sums of coordinate differences at various dimensions
+    // from two randomly generated points in the hypercube.
+    for (long r = 0; r < Randoms; ++r) {
+        // fill in the sum of powers for a single sample at various dimensions
+        // and powers.
+        for (int d=1; d <= Dimensions; ++d) {
+            // For each dimension, get 2 coordinates in this dimension.
+            // we only care about dx, the delta in the coordinate
+            // use abs value for odd powers calculation
+            double dx = domain_dx( Domain ) * extent[d-1];
+
+            // for each power, the sum will be the entry from the row above
+            // plus dx raised to that power.
+            for (int ip=0; ip<powerlist->size; ++ip) {
+                sums[d][ip] = sums[d-1][ip] + pow(dx,powerlist->val[ip]) ;
+            }
+        }
 
-void rangelist_print( struct rangelist * rl ) {
-    printf("Ranglist size=%d alloc=%d values= ",rl->size,rl->alloc);
-    for (int i = 0 ; i < rl->size ; ++i ) {
-        printf("%f ",rl->val[i]);
+        // Add the pth root of each sum to the totals
+        // (low dimensions done exactly are skipped)
+        for (int d=Exact+1; d <= Dimensions; ++d) {
+            for (int ip=0; ip<powerlist->size; ++ip) {
+                totals[d][ip] += sums[d][ip] ;
+                if (mom) {
+                    moments_add( mom, d*powerlist->size+ip, sums[d][ip] ) ;
+                }
+            }
+        }
     }
-    printf("\n") ;
 }
 
-struct rangelist * range( char * p_string )
+// Sample random segments keeping only one running sum per power.
+// Each dimension's sum is added to the totals as soon as it is
+// made, so memory is O(powers) rather than O(Dimensions*powers).
+void sample_stream( int Dimensions, struct rangelist * powerlist, long Randoms, int Exact, enum domain Domain, const double * extent, double totals[Dimensions+1][powerlist->size], struct moments * mom )
 {
-    // Interpret the string as a list of power values
-    // individual 1,2, 5
-    // ranges 1 _ 6
+    double running[powerlist->size];
 
-    char * rcopy = strdup( p_string ) ;
-    //printf("Full %s\n",rcopy) ;
+    for (long r = 0; r < Randoms; ++r) {
+        // zero dimensional case
+        for (int ip=0; ip<powerlist->size; ++ip) {
+            running[ip] = 0.;
+        }
 
-    struct rangelist * rl = rangelist_init() ;
-    
-    char * rcomma ;
-    char * rthis = strtok_r( rcopy, ",", &rcomma ) ;
+        for (int d=1; d <= Dimensions; ++d) {
+            double dx = domain_dx( Domain ) * extent[d-1];
 
-    while ( rthis != NULL ) {
-        //printf("Comma %s\n",rthis);
+            // add dx^p to the running sum for each power
+            for (int ip=0; ip<powerlist->size; ++ip) {
+                running[ip] += pow(dx,powerlist->val[ip]);
+            }
 
-        char * rbar ;
-        char * rthat = strtok_r( rthis, "_", &rbar ) ;
-        double p_val[3] ; // extent of range
-        int p_num = 0 ; // range elements
+            // and this dimension's sum (no root for the f-norm) to the totals
+            if (d > Exact) {
+                for (int ip=0; ip<powerlist->size; ++ip) {
+                    totals[d][ip] += running[ip];
+                    if (mom) {
+                        moments_add( mom, d*powerlist->size+ip, running[ip] ) ;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Sample a batch of random segments at a time, dimension by dimension.
+// A tile of running sums (powers x batch) is updated for each dimension
+// and folded into that dimension's totals once per batch rather than
+// once per sample.
+BATCH_CLONES
+void sample_batch( int Dimensions, struct rangelist * powerlist, long Randoms, int Exact, int Batch, enum domain Domain, const double * extent, double totals[Dimensions+1][powerlist->size], struct moments * mom )
+{
+    double (*tile)[Batch] = malloc( powerlist->size * sizeof( *tile ) ) ; // on the heap -- the powers have no limit
+    double dx[Batch];
+    int b;
 
-        while ( rthat != NULL ) {
-            //printf("\t Bar %s\n",rthat) ;
-            if ( p_num == 3 ) {
-                // only 3 entries in range allowed
-                break ;
+    for (long r = 0; r < Randoms; r += Batch) {
+        int size = ( Randoms - r < Batch ) ? (int) ( Randoms - r ) : Batch ;
+
+        // zero dimensional case
+        for (int ip=0; ip<powerlist->size; ++ip) {
+            for (b=0; b<size; ++b) {
+                tile[ip][b] = 0.;
             }
-            double v = atof(rthat) ;
-            if (v <= 0.) {
-                v = 1. ;
+        }
+
+        for (int d=1; d <= Dimensions; ++d) {
+            domain_fill( Domain, size, dx );
+            for (b=0; b<size; ++b) {
+                dx[b] *= extent[d-1];
             }
-            p_val[p_num++] = v ;
 
-            rthat = strtok_r( NULL, "_", &rbar ) ;
-        }
+            // add dx^p to the running sums (vectorizes across the batch)
+            for (int ip=0; ip<powerlist->size; ++ip) {
+                for (b=0; b<size; ++b) {
+                    tile[ip][b] += pow(dx[b],powerlist->val[ip]);
+                }
+            }
 
-        switch (p_num) {
-        case 0:
-            // no entries
-            break ;
-        case 1:
-            // single entry
-            p_val[1] = p_val[0] ;
-            // fall through ...
-        case 2:
-            // straight range
-            p_val[2] = 1 ;
-            // fall through ...
-        case 3:
-            for ( double v = p_val[0]; v <= p_val[1] ; v += p_val[2] ) {
-                rangelist_add( v, rl ) ;
+            // fold the value of each sample's sum into this dimension's totals
+            if (d > Exact) {
+                for (int ip=0; ip<powerlist->size; ++ip) {
+                    double sum = 0.;
+                    for (b=0; b<size; ++b) {
+                        sum += tile[ip][b];
+                    }
+                    totals[d][ip] += sum;
+                    if (mom) {
+                        for (b=0; b<size; ++b) {
+                            moments_add( mom, d*powerlist->size+ip, tile[ip][b] ) ;
+                        }
+                    }
+                }
             }
         }
-
-        rthis = strtok_r( NULL, "," , &rcomma ) ;
     }
+    free( tile ) ;
+}
 
-    free( rcopy ) ;
+// Sample random segments between points of a non-separable domain (ball, sphere, simplex).
+// The points change with the dimension, so every dimension sums all its
+// coordinate differences afresh -- O(Dimensions^2) per sample.
+void sample_points( int Dimensions, struct rangelist * powerlist, long Randoms, enum domain Domain, double totals[Dimensions+1][powerlist->size], struct moments * mom )
+{
+    double x[Dimensions], y[Dimensions];
+    double xscale[Dimensions+1], yscale[Dimensions+1];
+    double sums[powerlist->size];
+
+    for (long r = 0; r < Randoms; ++r) {
+        domain_points( Domain, Dimensions, x, y, xscale, yscale );
+
+        for (int d=1; d <= Dimensions; ++d) {
+            for (int ip=0; ip<powerlist->size; ++ip) {
+                sums[ip] = 0.;
+            }
+            // the first d coordinates at this dimension's scale
+            for (int i=0; i<d; ++i) {
+                double dx = fabs( x[i]*xscale[d] - y[i]*yscale[d] );
+                for (int ip=0; ip<powerlist->size; ++ip) {
+                    sums[ip] += pow(dx,powerlist->val[ip]);
+                }
+            }
+            for (int ip=0; ip<powerlist->size; ++ip) {
+                totals[d][ip] += sums[ip];
+                if (mom) {
+                    moments_add( mom, d*powerlist->size+ip, sums[ip] ) ;
+                }
+            }
+        }
+    }
+}
 
-    return rl ;
-} 
-     
 int main( int argc, char **argv )
 {
     int Dimensions = 100 ;
     long Randoms = 1000000 ;
     int Normalize = 0;
-
-    double scale = 1.0 / RAND_MAX ;
+    int Exact = 0; // dimensions done by integration rather than random points
+    int Batch = 0; // samples per batch (0 for one at a time)
+    int Moments = 0; // -M variance, skew, kurtosis too
+    enum domain Domain = DOMAIN_CUBE ;
+    const char * ExtentFile = NULL; // -w per-axis extents
+    unsigned long Seed = 0; // 0 for seeded from the clock
+    const char * Cache = NULL; // cache directory
+    int Stream = 0; // running sums only (no Dimensions x powers sums table)
 
     struct rangelist * powerlist = NULL ;
 
     // Arguments
+    static struct option long_options[] = {
+        { "exact-low-d", required_argument, 0, 'e' },
+        { "seed", required_argument, 0, 'S' },
+        { "cache", required_argument, 0, 'C' },
+        { "domain", required_argument, 0, 'D' },
+        { 0, 0, 0, 0 }
+    } ;
     int c;
-    while ( (c = getopt( argc, argv, "hd:p:r:n" )) != -1 ) {
+    while ( (c = getopt_long( argc, argv, "hd:p:r:ne:sb:S:C:Mw:", long_options, NULL )) != -1 ) {
         switch ( c ) {
         case 'h':
             help() ;
@@ -171,17 +265,57 @@ int main( int argc, char **argv )
         case 'n':
             Normalize = 1 ;
             break ;
+        case 's':
+            Stream = 1 ;
+            break ;
+        case 'b':
+            Batch = atoi(optarg);
+            if (Batch<1) {
+                Batch = -1 ; // size to cache
+            } else if (Batch>BATCH_MAX) {
+                Batch = BATCH_MAX ;
+            }
+            break ;
+        case 'e':
+            Exact = atoi(optarg);
+            if (Exact<0) {
+                Exact = 0 ;
+            }
+            break ;
+        case 'S':
+            Seed = strtoul(optarg, NULL, 0);
+            break ;
+        case 'C':
+            Cache = optarg ;
+            break ;
+        case 'M':
+            Moments = 1 ;
+            break ;
+        case 'D':
+            if ( domain_parse( optarg ) < 0 ) {
+                fprintf(stderr, "Unknown domain %s -- cube, torus, gaussian, ball, sphere or simplex\n", optarg);
+                exit(1);
+            }
+            Domain = domain_parse( optarg ) ;
+            break ;
+        case 'w':
+            ExtentFile = optarg ;
+            break ;
         }
     }
 
-    if ( powerlist==NULL ) {
+    // inf (the max metric) is only in distance_any
+    if ( powerlist && rangelist_finite( powerlist ) > 0 ) {
+        fprintf(stderr, "inf is for distance_any only -- dropped\n");
+    }
+    if ( powerlist==NULL || powerlist->size==0 ) {
         // default power range
+        if ( powerlist ) {
+            rangelist_free( powerlist ) ;
+        }
         powerlist = range("1_3");
     }
 
-    // Initialize random seed
-    srand(time(0));
-
     // Initialize totals to zero
     double totals[Dimensions+1][powerlist->size];
     for (int d=0; d <= Dimensions; ++d) {
@@ -190,36 +324,96 @@ int main( int argc, char **argv )
         }
     }
 
-    // zero out the first row (i.e. zero dimensional case) of the sums
-    double sums[Dimensions+1][powerlist->size];
-    for (int ip=0; ip<powerlist->size; ++ip) {
-        sums[0][ip] = 0.;
+    // Only the cube has exact low dimensions and only separable domains are batched
+    if (Domain != DOMAIN_CUBE && Exact) {
+        fprintf(stderr, "Exact low dimensions are for the cube only -- -e ignored\n");
+        Exact = 0 ;
+    }
+    if (!domain_separable( Domain ) && (Batch || Stream)) {
+        fprintf(stderr, "Domain %s is sampled a point pair at a time -- -s and -b ignored\n", domain_name( Domain ));
+        Batch = Stream = 0 ;
     }
 
-    // Generate and add up sums of coordinate differences at various dimensions
-    // from two randomly generated points in the hypercube.
-    for (long r = 0; r < Randoms; ++r) {
-        // fill in the sum of powers for a single sample at various dimensions
-        // and powers.
-        for (int d=1; d <= Dimensions; ++d) {
-            // For each dimension, get 2 coordinates in this dimension.
-            // we only care about dx, the delta in the coordinate
-            // use abs value for odd powers calculation
-            double dx = fabs((rand() - rand()) * scale);
-
-            // for each power, the sum will be the entry from the row above
-            // plus dx raised to that power.
-            for (int ip=0; ip<powerlist->size; ++ip) {
-                sums[d][ip] = sums[d-1][ip] + pow(dx,powerlist->val[ip]) ;
+    // Per-axis extents (all 1 for the unit cube)
+    double * extent = NULL ;
+    if (ExtentFile) {
+        if (!domain_separable( Domain )) {
+            fprintf(stderr, "Extents are for cube, torus and gaussian -- -w ignored\n");
+            ExtentFile = NULL ;
+        } else {
+            extent = domain_extents( ExtentFile, Dimensions ) ;
+            if (extent == NULL) {
+                exit(1);
+            }
+            if (Exact) {
+                fprintf(stderr, "Exact low dimensions are for the unit cube only -- -e ignored\n");
+                Exact = 0 ;
             }
+            if (Cache) {
+                fprintf(stderr, "Extents are not cached -- -C ignored\n");
+                Cache = NULL ;
+            }
+        }
+    }
+    if (extent == NULL) {
+        extent = malloc( Dimensions * sizeof( double ) ) ;
+        for (int i=0; i<Dimensions; ++i) {
+            extent[i] = 1. ;
         }
+    }
 
-        // Add the pth root of each sum to the totals
-        for (int d=1; d <= Dimensions; ++d) {
-            for (int ip=0; ip<powerlist->size; ++ip) {
-                totals[d][ip] += sums[d][ip] ;
-            }
+    // Longest segment for each dimension and power (for -n)
+    double (*diagonal)[powerlist->size] = malloc( (Dimensions+1) * sizeof( *diagonal ) ) ;
+    domain_diagonals( Domain, Dimensions, powerlist->size, powerlist->val, ExtentFile ? extent : NULL, &diagonal[0][0], NULL ) ;
+
+    // Higher moments of the length in each cell
+    struct moments * mom = NULL ;
+    if (Moments) {
+        if (Cache) {
+            fprintf(stderr, "Moments are not cached -- -C ignored\n");
+            Cache = NULL ;
+        }
+        mom = moments_init( (Dimensions+1)*powerlist->size ) ;
+    }
+
+    if (Batch < 0) {
+        Batch = batch_autosize( powerlist->size ) ;
+    }
+
+    // Start from earlier results of the same run (and engine) if cached
+    long Cached = 0; // samples already in the totals
+    struct cache_entry entry ;
+    if (Cache) {
+        char engine[32] ;
+        cache_engine( engine, sizeof( engine ), domain_separable( Domain ), Batch, Stream, 0 ) ;
+        cache_key( &entry, "distance_f", powerlist->size, powerlist->val, Exact, "fp64", "rand", Seed, engine, domain_name( Domain ) ) ;
+        Cached = cache_fetch( Cache, &entry, Dimensions, Randoms, &totals[0][0] ) ;
+    }
+    long Draw = ( Randoms > Cached ) ? Randoms - Cached : 0 ; // new samples needed
+    if (Randoms < Cached) {
+        Randoms = Cached ; // use all the samples there are
+    }
+
+    // Initialize random seed
+    // (each extension of a cached result continues with the next seed)
+    srand( Seed ? Seed + ( Cache ? entry.segments : 0 ) : (unsigned long) time(0) );
+
+    // Generate the random segments
+    if (!domain_separable( Domain )) {
+        sample_points( Dimensions, powerlist, Draw, Domain, totals, mom ) ;
+    } else if (Batch) {
+        sample_batch( Dimensions, powerlist, Draw, Exact, Batch, Domain, extent, totals, mom ) ;
+    } else if (Stream) {
+        sample_stream( Dimensions, powerlist, Draw, Exact, Domain, extent, totals, mom ) ;
+    } else {
+        sample_prefix( Dimensions, powerlist, Draw, Exact, Domain, extent, totals, mom ) ;
+    }
+
+    if (Cache) {
+        if (Draw > 0) {
+            cache_save( Cache, &entry, Dimensions, Randoms, entry.segments+1, &totals[0][0] ) ;
         }
+        cache_free( &entry ) ;
     }
 
     // Title line
@@ -227,6 +421,17 @@ int main( int argc, char **argv )
     for (int ip=0;ip<powerlist->size;++ip) {
         printf("%.2f, ",powerlist->val[ip]);
     }
+    if (mom) {
+        for (int ip=0;ip<powerlist->size;++ip) {
+            printf("var %.2f, ",powerlist->val[ip]);
+        }
+        for (int ip=0;ip<powerlist->size;++ip) {
+            printf("skew %.2f, ",powerlist->val[ip]);
+        }
+        for (int ip=0;ip<powerlist->size;++ip) {
+            printf("kurt %.2f, ",powerlist->val[ip]);
+        }
+    }
     printf("\n");
 
     // Loop though dimensions
@@ -236,17 +441,43 @@ int main( int argc, char **argv )
 
         // Print out the distances
         for (int ip=0;ip<powerlist->size;++ip) {
-            if (Normalize) {
-                printf("%g, ", totals[d][ip]/Randoms/d);
+            if (d <= Exact) {
+                // numerical integration -- show the extra digits
+                double length = exact_fnorm( d, powerlist->val[ip] ) ;
+                if (Normalize) {
+                    length /= d;
+                }
+                printf("%.15g, ", length);
+            } else if (Normalize) {
+                printf("%g, ", totals[d][ip]/Randoms/pow( diagonal[d][ip], powerlist->val[ip] ));
             } else {
                 printf("%g, ", totals[d][ip]/Randoms);
             }
         }
+
+        // moment column groups (variance scales with the square of the length)
+        if (mom) {
+            for (int ip=0;ip<powerlist->size;++ip) {
+                double scale = Normalize ? pow( diagonal[d][ip], powerlist->val[ip] ) : 1. ;
+                printf("%g, ", moments_variance( mom, d*powerlist->size+ip )/(scale*scale));
+            }
+            for (int ip=0;ip<powerlist->size;++ip) {
+                printf("%g, ", moments_skew( mom, d*powerlist->size+ip ));
+            }
+            for (int ip=0;ip<powerlist->size;++ip) {
+                printf("%g, ", moments_kurtosis( mom, d*powerlist->size+ip ));
+            }
+        }
         // finish line
         printf("\n");
     }
 
     // success
+    free( extent ) ;
+    free( diagonal ) ;
+    if (mom) {
+        moments_free( mom ) ;
+    }
     rangelist_free( powerlist ) ;
     return 0 ;
 }
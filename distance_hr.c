@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <malloc.h>
+#include <math.h>
+
+#include "moments.h"
 
 void help( void )
 {
@@ -26,6 +29,9 @@ void help( void )
     printf("\t-p 3\tmax power (metric)\n");
     printf("\t-r 1000000\trandom points each measure\n");
     printf("\t-n\tnormalize (to longest diagonal)\n");
+    printf("\t-s\tstream -- running sums only, memory O(powers) rather than O(dimensions*powers)\n");
+    printf("\t-M\tmoments -- variance, skew and excess kurtosis column groups after the means\n");
+    printf("\t\t(in double precision)\n");
     printf("\t-h\tthis help\n");
     exit(0) ;
 }
@@ -36,6 +42,8 @@ int main( int argc, char **argv )
     int Powers = 3 ;
     long Randoms = 1000000 ;
     int Normalize = 0;
+    int Stream = 0; // running sums only (no Dimensions x Powers sums table)
+    int Moments = 0; // -M variance, skew, kurtosis too
 
     // random state
     gmp_randstate_t rstate;
@@ -43,7 +51,7 @@ int main( int argc, char **argv )
 
     // Arguments
     int c;
-    while ( (c = getopt( argc, argv, "hd:p:r:n" )) != -1 ) {
+    while ( (c = getopt( argc, argv, "hd:p:r:nsM" )) != -1 ) {
         switch ( c ) {
         case 'h':
             help() ;
@@ -69,6 +77,12 @@ int main( int argc, char **argv )
         case 'n':
             Normalize = 1 ;
             break ;
+        case 's':
+            Stream = 1 ;
+            break ;
+        case 'M':
+            Moments = 1 ;
+            break ;
         }
     }
 
@@ -94,51 +108,88 @@ int main( int argc, char **argv )
     mpfr_init(root);
 
     // Initialize totals to zero
-    // zero out the first row (i.e. zero dimensional case) of the sums
-    // for GMP have to initialize them all
     mpfr_t totals[Dimensions+1][Powers];
-    mpfr_t sums[Dimensions+1][Powers];
     int d,p;
     for (d=0; d <= Dimensions; ++d) {
         for (p=0; p<Powers; ++p) {
-
             mpfr_init( totals[d][p] );
             mpfr_set_zero( totals[d][p], MPFR_RNDN );
-            
+        }
+    }
+
+    // zero out the first row (i.e. zero dimensional case) of the sums
+    // for GMP have to initialize them all
+    // streaming only needs one row, reused for each dimension
+    int rows = Stream ? 1 : Dimensions+1 ;
+    // the spread needs far less than the mean's precision, so moments are kept in double
+    struct moments * mom = Moments ? moments_init( (Dimensions+1)*Powers ) : NULL ;
+    mpfr_t sums[rows][Powers];
+    for (d=0; d < rows; ++d) {
+        for (p=0; p<Powers; ++p) {
             mpfr_init( sums[d][p] );
             mpfr_set_zero( sums[d][p], MPFR_RNDN );
         }
     }
 
-    // Generate and add up sums of coordinate differences at various dimensions
-    // from two randomly generated points in the hypercube.
-    for (long r = 0; r < Randoms; ++r) {
-        // fill in the sum of powers for a single sample at various dimensions
-        // and powers.
-        for (d=1; d <= Dimensions; ++d) {
-            // For each dimension, get 2 coordinates in this dimension.
-            // we only care about dx, the delta in the coordinate
-            // use abs value for odd powers calculation
-            mpfr_urandomb( x1 , rstate );
-            mpfr_urandomb( x2 , rstate );
-            mpfr_sub( dx, x1, x2, MPFR_RNDN );
-            mpfr_abs( dx, dx, MPFR_RNDN ) ;
-
-            // for each power, the sum will be the entry from the row above
-            // plus dx raised to that power.
-            mpfr_set_d( cumprod, 1.0, MPFR_RNDN ) ;
+    if (Stream) {
+        // One running sum per power -- take the root as each dimension is added
+        for (long r = 0; r < Randoms; ++r) {
             for (p=0; p<Powers; ++p) {
-                mpfr_mul( cumprod, cumprod, dx, MPFR_RNDN );
-                mpfr_add( sums[d][p], sums[d-1][p], cumprod, MPFR_RNDN );
+                mpfr_set_zero( sums[0][p], MPFR_RNDN );
+            }
+            for (d=1; d <= Dimensions; ++d) {
+                mpfr_urandomb( x1 , rstate );
+                mpfr_urandomb( x2 , rstate );
+                mpfr_sub( dx, x1, x2, MPFR_RNDN );
+                mpfr_abs( dx, dx, MPFR_RNDN ) ;
+
+                mpfr_set_d( cumprod, 1.0, MPFR_RNDN ) ;
+                for (p=0; p<Powers; ++p) {
+                    mpfr_mul( cumprod, cumprod, dx, MPFR_RNDN );
+                    mpfr_add( sums[0][p], sums[0][p], cumprod, MPFR_RNDN );
+                    // note p is 0-indexed in C, but 1-indexed for calculation
+                    mpfr_rootn_ui( root, sums[0][p], p+1, MPFR_RNDN ); // root used as a scratch variable
+                    mpfr_add( totals[d][p], totals[d][p], root, MPFR_RNDN );
+                    if (mom) {
+                        moments_add( mom, d*Powers+p, mpfr_get_d( root, MPFR_RNDN ) ) ;
+                    }
+                }
             }
         }
+    } else {
+        // Generate and add up sums of coordinate differences at various dimensions
+        // from two randomly generated points in the hypercube.
+        for (long r = 0; r < Randoms; ++r) {
+            // fill in the sum of powers for a single sample at various dimensions
+            // and powers.
+            for (d=1; d <= Dimensions; ++d) {
+                // For each dimension, get 2 coordinates in this dimension.
+                // we only care about dx, the delta in the coordinate
+                // use abs value for odd powers calculation
+                mpfr_urandomb( x1 , rstate );
+                mpfr_urandomb( x2 , rstate );
+                mpfr_sub( dx, x1, x2, MPFR_RNDN );
+                mpfr_abs( dx, dx, MPFR_RNDN ) ;
 
-        // Add the pth root of each sum to the totals
-        for (d=1; d <= Dimensions; ++d) {
-            for (p=0; p<Powers; ++p) {
-                // note p is 0-indexed in C, but 1-indexed for calculation
-                mpfr_rootn_ui( root, sums[d][p], p+1, MPFR_RNDN ); // root used as a scratch variable
-                mpfr_add( totals[d][p], totals[d][p], root, MPFR_RNDN ); 
+                // for each power, the sum will be the entry from the row above
+                // plus dx raised to that power.
+                mpfr_set_d( cumprod, 1.0, MPFR_RNDN ) ;
+                for (p=0; p<Powers; ++p) {
+                    mpfr_mul( cumprod, cumprod, dx, MPFR_RNDN );
+                    mpfr_add( sums[d][p], sums[d-1][p], cumprod, MPFR_RNDN );
+                }
+            }
+
+            // Add the pth root of each sum to the totals
+            for (d=1; d <= Dimensions; ++d) {
+                for (p=0; p<Powers; ++p) {
+                    // note p is 0-indexed in C, but 1-indexed for calculation
+                    mpfr_rootn_ui( root, sums[d][p], p+1, MPFR_RNDN ); // root used as a scratch variable
+                    mpfr_add( totals[d][p], totals[d][p], root, MPFR_RNDN ); 
+                    if (mom) {
+                        moments_add( mom, d*Powers+p, mpfr_get_d( root, MPFR_RNDN ) ) ;
+                    }
+                }
             }
         }
     }
@@ -148,6 +199,17 @@ int main( int argc, char **argv )
     for (p=1;p<=Powers;++p) {
         printf("%d, ",p);
     }
+    if (mom) {
+        for (p=1;p<=Powers;++p) {
+            printf("var %d, ",p);
+        }
+        for (p=1;p<=Powers;++p) {
+            printf("skew %d, ",p);
+        }
+        for (p=1;p<=Powers;++p) {
+            printf("kurt %d, ",p);
+        }
+    }
     printf("\n");
 
     // Loop though dimensions
@@ -173,11 +235,28 @@ int main( int argc, char **argv )
             // Print out distances
             mpfr_printf("%.32Rf, ", totals[d][p]);
         }
+
+        // moment column groups (variance scales with the square of the length)
+        if (mom) {
+            for (p=0;p<Powers;++p) {
+                double scale = Normalize ? pow(d,1./(1+p)) : 1. ;
+                printf("%g, ", moments_variance( mom, d*Powers+p )/(scale*scale));
+            }
+            for (p=0;p<Powers;++p) {
+                printf("%g, ", moments_skew( mom, d*Powers+p ));
+            }
+            for (p=0;p<Powers;++p) {
+                printf("%g, ", moments_kurtosis( mom, d*Powers+p ));
+            }
+        }
         // finish line
         printf("\n");
     }
 
     // success
+    if (mom) {
+        moments_free( mom ) ;
+    }
     return 0 ;
 }
 
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "rangelist.h"
+#include "batch.h"
+#include "family.h"
+#include "place.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Nearest neighbour distance among N random points in the unit cube
+//
+// Each trial places N points and finds, for every point, its k'th nearest
+// neighbour in every dimension d <= Dimensions and every power. The points in
+// d dimensions are the first d coordinates, so a pair's running sums grow one
+// dimension at a time as in distance_any, and a point's k smallest sums are
+// kept for each (d,p). The root is only taken at the end -- it doesn't change the order.
+//
+// The all-pairs step is tiled: a block of NN_ROWS points against a block of
+// columns sized to L1 (batch_autosize), with a (powers x rows x columns) tile
+// of running sums updated one dimension at a time. Each thread takes whole
+// row blocks and runs them against every column block, so the pairs are
+// computed from both ends but no thread writes another's neighbours.
+// Threads are pinned across the NUMA nodes with their totals on their own
+// node, the points interleaved over the nodes, and the totals summed node by
+// node at the end of the last trial (place.h).
+
+#define NN_ROWS 8 // points per row block
+#define NN_MULTIPLY 16 // whole powers up to this are multiplied out
+
+void help( void )
+{
+    printf("distance_nn -- find the average nearest neighbour distance among N random points in\n") ;
+    printf("\ta unit N-cube using Monti Carlo method.\n");
+    printf("\n");
+    printf("By Paul H Alfille 2021 -- MIT license\n") ;
+    printf("\n");
+    printf("Output is CSV file format to make easy manipulation.\n");
+    printf("Each entry is the mean over all points of all trials.\n");
+    printf("\n");
+    printf("Syntax:\n");
+    printf("\tdistance_nn [options]\n");
+    printf("Options:\n");
+    printf("\t-d 10\tmax dimensions\n");
+    printf("\t-p \"1_3\"\tmetric powers -- same syntax as distance_any (inf allowed)\n");
+    printf("\t-N 1000\tpoints in each trial\n");
+    printf("\t-k 1\tk'th nearest neighbour\n");
+    printf("\t-r 10\ttrials (sets of N points)\n");
+    printf("\t-n\tnormalize (to longest diagonal)\n");
+    printf("\t-t 4\tthreads (default one per processor)\n");
+    printf("\t-S 42\trandom seed (default from the clock)\n");
+    printf("\t-h\tthis help\n");
+    exit(0) ;
+}
+
+// One trial's work shared by the threads
+struct trial {
+    int Dimensions ;
+    int Points ;
+    int K ;
+    int Powers ;
+    const double * val ;
+    const enum family * family ;
+    int Columns ; // points per column block
+    const double * x ; // coordinates, dimension major: x[k*Points+i]
+    int next ; // next row block to take
+    struct place * place ;
+    double ** totals ; // every thread's
+    pthread_barrier_t * barrier ; // last trial only -- then reduce per node
+} ;
+
+// One thread: its row blocks and its share of the totals
+struct worker {
+    pthread_t thread ;
+    int id ;
+    struct trial * trial ;
+} ;
+
+// Keep the K smallest (sorted) with v if it belongs
+static inline void nn_insert( int K, double best[K], double v )
+{
+    if ( v >= best[K-1] ) {
+        return ;
+    }
+    int i = K-1 ;
+    while ( i > 0 && best[i-1] > v ) {
+        best[i] = best[i-1] ;
+        --i ;
+    }
+    best[i] = v ;
+}
+
+// Row block of rows points starting at i0 against all columns
+static void nn_rows( struct trial * t, int i0, int rows, double * totals )
+{
+    int Dimensions = t->Dimensions ;
+    int N = t->Points ;
+    int K = t->K ;
+    int Powers = t->Powers ;
+    int Columns = t->Columns ;
+
+    double (*best)[Dimensions+1][Powers][K] = malloc( rows * sizeof( *best ) ) ;
+    double (*tile)[NN_ROWS][Columns] = malloc( Powers * sizeof( *tile ) ) ;
+    double dx[Columns], term[Columns] ;
+    for (int bi=0; bi<rows; ++bi) {
+        for (int d=0; d<=Dimensions; ++d) {
+            for (int ip=0; ip<Powers; ++ip) {
+                for (int k=0; k<K; ++k) {
+                    best[bi][d][ip][k] = HUGE_VAL ;
+                }
+            }
+        }
+    }
+
+    for (int j0=0; j0<N; j0+=Columns) {
+        int size = ( N - j0 < Columns ) ? N - j0 : Columns ;
+
+        // zero dimensional case -- a point isn't its own neighbour
+        for (int ip=0; ip<Powers; ++ip) {
+            for (int bi=0; bi<rows; ++bi) {
+                for (int b=0; b<size; ++b) {
+                    tile[ip][bi][b] = ( i0+bi == j0+b ) ? HUGE_VAL : 0. ;
+                }
+            }
+        }
+
+        for (int d=1; d<=Dimensions; ++d) {
+            const double * xi = &t->x[(d-1)*N+i0] ;
+            const double * xj = &t->x[(d-1)*N+j0] ;
+
+            // update the running sums (vectorizes across the columns)
+            for (int ip=0; ip<Powers; ++ip) {
+                double p = t->val[ip] ;
+                for (int bi=0; bi<rows; ++bi) {
+                    double * run = tile[ip][bi] ;
+                    double x = xi[bi] ;
+                    switch ( t->family[ip] ) {
+                    case FAMILY_SMALL_P:
+                        for (int b=0; b<size; ++b) {
+                            run[b] += expm1( p*log( fabs( x-xj[b] ) ) ) ;
+                        }
+                        break ;
+                    case FAMILY_INF:
+                        for (int b=0; b<size; ++b) {
+                            run[b] = fmax( run[b], fabs( x-xj[b] ) ) ;
+                        }
+                        break ;
+                    default:
+                        if ( p == 1. ) {
+                            for (int b=0; b<size; ++b) {
+                                run[b] += fabs( x-xj[b] ) ;
+                            }
+                        } else if ( p == 2. ) {
+                            for (int b=0; b<size; ++b) {
+                                run[b] += ( x-xj[b] ) * ( x-xj[b] ) ;
+                            }
+                        } else if ( p == rint( p ) && p <= NN_MULTIPLY ) {
+                            // whole powers by repeated multiplication -- pow doesn't vectorize
+                            for (int b=0; b<size; ++b) {
+                                dx[b] = fabs( x-xj[b] ) ;
+                                term[b] = dx[b] ;
+                            }
+                            for (int e=1; e<(int) p; ++e) {
+                                for (int b=0; b<size; ++b) {
+                                    term[b] *= dx[b] ;
+                                }
+                            }
+                            for (int b=0; b<size; ++b) {
+                                run[b] += term[b] ;
+                            }
+                        } else {
+                            for (int b=0; b<size; ++b) {
+                                run[b] += pow( fabs( x-xj[b] ), p ) ;
+                            }
+                        }
+                        break ;
+                    }
+                }
+            }
+
+            // nearest so far in this dimension
+            for (int ip=0; ip<Powers; ++ip) {
+                for (int bi=0; bi<rows; ++bi) {
+                    double * run = tile[ip][bi] ;
+                    double * b_best = best[bi][d][ip] ;
+                    for (int b=0; b<size; ++b) {
+                        if ( run[b] < b_best[K-1] ) {
+                            nn_insert( K, b_best, run[b] ) ;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // k'th nearest lengths into the totals
+    for (int bi=0; bi<rows; ++bi) {
+        for (int d=1; d<=Dimensions; ++d) {
+            for (int ip=0; ip<Powers; ++ip) {
+                totals[d*Powers+ip] += family_length( t->family[ip], t->val[ip], best[bi][d][ip][K-1], d, 0., 0. ) ;
+            }
+        }
+    }
+    free( tile ) ;
+    free( best ) ;
+}
+
+void * nn_thread( void * arg )
+{
+    struct worker * w = arg ;
+    struct trial * t = w->trial ;
+    size_t cells = (size_t) ( t->Dimensions+1 ) * t->Powers ;
+    place_pin( t->place, w->id ) ;
+    if ( t->totals[w->id] == NULL ) {
+        // first trial -- allocated (so first touched) on this thread's node
+        t->totals[w->id] = place_zeros( t->place, cells ) ;
+    }
+
+    int blocks = ( t->Points + NN_ROWS - 1 ) / NN_ROWS ;
+    int block ;
+    while ( ( block = __atomic_fetch_add( &t->next, 1, __ATOMIC_RELAXED ) ) < blocks ) {
+        int i0 = block * NN_ROWS ;
+        int rows = ( t->Points - i0 < NN_ROWS ) ? t->Points - i0 : NN_ROWS ;
+        nn_rows( t, i0, rows, t->totals[w->id] ) ;
+    }
+
+    if ( t->barrier ) {
+        pthread_barrier_wait( t->barrier ) ;
+        place_reduce( t->place, w->id, t->totals, cells ) ;
+    }
+    return NULL ;
+}
+
+int main( int argc, char **argv )
+{
+    int Dimensions = 10 ;
+    int Points = 1000 ;
+    int K = 1 ;
+    long Trials = 10 ;
+    int Normalize = 0 ;
+    int Threads = 0 ; // 0 for one per processor
+    unsigned long Seed = 0 ; // 0 for seeded from the clock
+
+    struct rangelist * powerlist = NULL ;
+
+    // Arguments
+    int c;
+    while ( (c = getopt( argc, argv, "hd:p:N:k:r:nt:S:" )) != -1 ) {
+        switch ( c ) {
+        case 'h':
+            help() ;
+            break ;
+        case 'd':
+            Dimensions = atoi(optarg);
+            if (Dimensions<1) {
+                Dimensions = 1 ;
+            }
+            break ;
+        case 'p':
+            powerlist = range( optarg ) ;
+            break ;
+        case 'N':
+            Points = atoi(optarg);
+            if (Points<2) {
+                Points = 2 ;
+            }
+            break ;
+        case 'k':
+            K = atoi(optarg);
+            if (K<1) {
+                K = 1 ;
+            }
+            break ;
+        case 'r':
+            Trials = atol(optarg);
+            if (Trials<1) {
+                Trials = 1 ;
+            }
+            break ;
+        case 'n':
+            Normalize = 1 ;
+            break ;
+        case 't':
+            Threads = atoi(optarg);
+            break ;
+        case 'S':
+            Seed = strtoul(optarg, NULL, 0);
+            break ;
+        }
+    }
+
+    if ( powerlist==NULL ) {
+        // default power range
+        powerlist = range("1_3");
+    }
+    if ( K >= Points ) {
+        fprintf(stderr, "Only %d other points -- -k %d ignored\n", Points-1, K);
+        K = 1 ;
+    }
+    if ( Threads < 1 ) {
+        Threads = (int) sysconf( _SC_NPROCESSORS_ONLN ) ;
+        if ( Threads < 1 ) {
+            Threads = 1 ;
+        }
+    }
+    int Powers = powerlist->size ;
+    enum family family[Powers] ;
+    for (int ip=0; ip<Powers; ++ip) {
+        family[ip] = family_of( powerlist->val[ip] ) ;
+    }
+
+    srand( Seed ? Seed : (unsigned long) time(0) );
+
+    struct place * pl = place_init( Threads ) ;
+    size_t cells = (size_t) ( Dimensions+1 ) * Powers ;
+    double * x = place_spread( pl, (size_t) Dimensions * Points ) ;
+    double (*totals)[Powers] = calloc( Dimensions+1, sizeof( *totals ) ) ;
+    double * thread_totals[Threads] ;
+    struct worker w[Threads] ;
+    for (int i=0; i<Threads; ++i) {
+        w[i].id = i ;
+        thread_totals[i] = NULL ;
+    }
+    pthread_barrier_t barrier ;
+    pthread_barrier_init( &barrier, NULL, Threads ) ;
+
+    // columns so the tile of running sums for a row block stays in L1
+    int Columns = batch_autosize( Powers * NN_ROWS ) ;
+
+    for (long r=0; r<Trials; ++r) {
+        // N random points
+        for (long i=0; i<(long) Dimensions*Points; ++i) {
+            x[i] = rand() * (1.0 / RAND_MAX) ;
+        }
+
+        struct trial t = { Dimensions, Points, K, Powers, powerlist->val, family, Columns, x, 0,
+            pl, thread_totals, ( r == Trials-1 ) ? &barrier : NULL } ;
+        for (int i=0; i<Threads; ++i) {
+            w[i].trial = &t ;
+            pthread_create( &w[i].thread, NULL, nn_thread, &w[i] ) ;
+        }
+        for (int i=0; i<Threads; ++i) {
+            pthread_join( w[i].thread, NULL ) ;
+        }
+    }
+
+    // threads' totals together -- each node's already summed by the last trial
+    place_total( pl, thread_totals, cells, &totals[0][0] ) ;
+    for (int i=0; i<Threads; ++i) {
+        place_release( pl, thread_totals[i], cells ) ;
+    }
+    pthread_barrier_destroy( &barrier ) ;
+
+    // Title line
+    char label[Powers][32];
+    printf("DIM\\Power, ");
+    for (int ip=0; ip<Powers; ++ip) {
+        family_label( label[ip], sizeof( label[ip] ), powerlist->val[ip] ) ;
+        printf("%s, ",label[ip]);
+    }
+    printf("\n");
+
+    // Loop though dimensions
+    // (small p lengths are in units of d^(1/p) -- the diagonal)
+    double count = (double) Trials * Points ;
+    for (int d=1; d<=Dimensions; ++d) {
+        printf("%d, ",d);
+        for (int ip=0; ip<Powers; ++ip) {
+            double p = powerlist->val[ip] ;
+            double unit ;
+            if ( family[ip] == FAMILY_SMALL_P ) {
+                unit = Normalize ? 1. : exp( log( d ) / p ) ;
+            } else {
+                unit = Normalize ? pow( d, -1./p ) : 1. ;
+            }
+            printf("%g, ", totals[d][ip]/count*unit);
+        }
+        printf("\n");
+    }
+
+    // success
+    free( totals ) ;
+    place_release( pl, x, (size_t) Dimensions * Points ) ;
+    place_free( pl ) ;
+    rangelist_free( powerlist ) ;
+    return 0 ;
+}
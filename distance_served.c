@@ -0,0 +1,525 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "rangelist.h"
+#include "refine.h"
+
+#define MIN_SAMPLES 1000 // before the first answer
+#define CHUNK 1000 // samples a worker adds at a time
+#define DEFAULT_ERROR 0.001
+#define MAX_DIMENSIONS 10000 // largest d a query may ask for (each worker keeps 2 x d x powers sums)
+
+void help( void )
+{
+    printf("distance_served -- keep average distance tables in memory and answer\n") ;
+    printf("\tqueries about them on a Unix domain socket.\n");
+    printf("\n");
+    printf("By Paul H Alfille 2021 -- MIT license\n") ;
+    printf("\n");
+    printf("A pool of worker threads keeps adding random samples to every table\n");
+    printf("that has been asked for until its error bar meets the target,\n");
+    printf("so a repeated query is answered at once with the best estimate so far.\n");
+    printf("\n");
+    printf("Syntax:\n");
+    printf("\tdistance_served [options]\n");
+    printf("Options:\n");
+    printf("\t-u /tmp/distance.sock\tsocket path\n");
+    printf("\t-t 4\tworker threads (default one per processor)\n");
+    printf("\t-h\tthis help\n");
+    printf("\n");
+    printf("Queries are one line, answered by a CSV table and an empty line:\n");
+    printf("\tnorm=lp p=1_3 d=1_100 err=0.001 n=1\n");
+    printf("\t\tnorm\tlp (as distance_any, default) or f (as distance_f)\n");
+    printf("\t\tp\tpowers, same syntax as distance_any -p (default 1_3)\n");
+    printf("\t\td\tdimensions, same syntax (default 1_100, at most %d)\n", MAX_DIMENSIONS);
+    printf("\t\terr\ttarget standard error of each entry as printed (default 0.001)\n");
+    printf("\t\tn\t1 to normalize (to longest diagonal)\n");
+    printf("\tEach row is: dimension, then value and error for each power\n");
+    exit(0) ;
+}
+
+enum norm { NORM_LP, NORM_F } ;
+
+// Accumulated samples for one norm and power list
+// the refine slots (one per worker) hold the sums then the squares,
+// each (dimensions+1) x powers, so queries never stop the workers
+struct table {
+    struct table * next ;
+    enum norm norm ;
+    int dimensions ;
+    int powers ;
+    double * values ;
+    double target ; // smallest error asked for
+    double normal_target ; // and for normalized answers (n=1), in units of the diagonal
+    // under pool lock
+    int done ; // target met -- workers skip it
+    int retired ; // replaced by a table with more dimensions
+    int users ; // workers and queries using it
+
+    struct refine * rf ;
+    size_t cells ; // in the sums (and again in the squares)
+    size_t worst ; // cell short of its target at the last full check -- the only one tested until it passes
+
+    pthread_mutex_t lock ; // for the first answer only
+    pthread_cond_t ready ; // MIN_SAMPLES reached
+    int first ; // MIN_SAMPLES reached
+} ;
+
+// All tables, and the workers' signal that there is work
+struct pool {
+    pthread_mutex_t lock ;
+    pthread_cond_t work ;
+    struct table * tables ;
+    struct table * cursor ; // round robin between tables
+} ;
+
+static int Workers ; // threads, each with its own refine slot
+
+static struct pool Pool = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    NULL,
+    NULL,
+} ;
+
+// Add Samples random segments to sum and square (both zeroed by the caller)
+// running sums one dimension at a time as in distance -s
+void sample_chunk( enum norm norm, int Dimensions, int Powers, const double * values, long Samples, unsigned short rng[3], double * sum, double * square )
+{
+    double running[Powers] ;
+    for ( long r = 0 ; r < Samples ; ++r ) {
+        for ( int ip = 0 ; ip < Powers ; ++ip ) {
+            running[ip] = 0. ;
+        }
+        for ( int d = 1 ; d <= Dimensions ; ++d ) {
+            double dx = fabs( erand48( rng ) - erand48( rng ) ) ;
+            for ( int ip = 0 ; ip < Powers ; ++ip ) {
+                running[ip] += pow( dx, values[ip] ) ;
+                double length = ( norm == NORM_LP ) ? pow( running[ip], 1./values[ip] ) : running[ip] ;
+                sum[d*Powers+ip] += length ;
+                square[d*Powers+ip] += length * length ;
+            }
+        }
+    }
+}
+
+// Standard error of the mean from sum and sum of squares
+double table_cell_error( double sum, double square, long samples )
+{
+    double mean = sum / samples ;
+    double variance = square / samples - mean * mean ;
+    return variance > 0. ? sqrt( variance / ( samples - 1 ) ) : 0. ;
+}
+
+// Largest error allowed in a cell, in the units of the sums
+// (a normalized answer is divided by the diagonal, and so is its error)
+double table_cell_limit( struct table * t, size_t cell, double target, double normal_target )
+{
+    int d = cell / t->powers ;
+    double diagonal = ( t->norm == NORM_F ) ? d : pow( d, 1/t->values[cell % t->powers] ) ;
+    return fmin( target, normal_target * diagonal ) ;
+}
+
+// First cell of a snapshot of the table short of its target (t->cells if none)
+size_t table_short( struct table * t, const double * snapshot, long samples, double target, double normal_target )
+{
+    for ( size_t i = t->powers ; i < t->cells ; ++i ) {
+        double error = table_cell_error( snapshot[i], snapshot[t->cells+i], samples ) ;
+        if ( error > table_cell_limit( t, i, target, normal_target ) ) {
+            return i ;
+        }
+    }
+    return t->cells ;
+}
+
+// Pick the next table that needs samples (under pool lock)
+struct table * pool_next( void )
+{
+    struct table * start = Pool.cursor ? Pool.cursor->next : NULL ;
+    if ( start == NULL ) {
+        start = Pool.tables ;
+    }
+    struct table * t = start ;
+    while ( t ) {
+        if ( ! t->done && ! t->retired ) {
+            Pool.cursor = t ;
+            return t ;
+        }
+        t = t->next ? t->next : Pool.tables ;
+        if ( t == start ) {
+            break ;
+        }
+    }
+    return NULL ;
+}
+
+// Free retired tables nobody is using (under pool lock)
+void pool_sweep( void )
+{
+    struct table ** link = &Pool.tables ;
+    while ( *link ) {
+        struct table * t = *link ;
+        if ( t->retired && t->users == 0 ) {
+            *link = t->next ;
+            if ( Pool.cursor == t ) {
+                Pool.cursor = NULL ;
+            }
+            pthread_mutex_destroy( &t->lock ) ;
+            pthread_cond_destroy( &t->ready ) ;
+            free( t->values ) ;
+            refine_free( t->rf ) ;
+            free( t ) ;
+        } else {
+            link = &t->next ;
+        }
+    }
+}
+
+void * worker( void * arg )
+{
+    unsigned short rng[3] ;
+    long id = (long) arg ;
+    rng[0] = 0x330E ;
+    rng[1] = (unsigned short) ( time( NULL ) ^ ( id << 8 ) ) ;
+    rng[2] = (unsigned short) ( id * 40503 + getpid() ) ;
+
+    pthread_mutex_lock( &Pool.lock ) ;
+    while ( 1 ) {
+        struct table * t = pool_next() ;
+        if ( t == NULL ) {
+            pthread_cond_wait( &Pool.work, &Pool.lock ) ;
+            continue ;
+        }
+        ++t->users ;
+        double target = t->target ;
+        double normal_target = t->normal_target ;
+        pthread_mutex_unlock( &Pool.lock ) ;
+
+        // sample outside any lock, then add to this worker's slot
+        double * chunk = calloc( 2 * t->cells, sizeof( double ) ) ;
+        sample_chunk( t->norm, t->dimensions, t->powers, t->values, CHUNK, rng, chunk, chunk + t->cells ) ;
+        refine_publish( t->rf, id, chunk, CHUNK ) ;
+
+        // test the cell that fell short last time (its sum and square);
+        // only once that passes is the whole table copied to look for another
+        int done = 0 ;
+        size_t worst = __atomic_load_n( &t->worst, __ATOMIC_RELAXED ) ;
+        size_t cell[2] = { worst, t->cells + worst } ;
+        double value[2] ;
+        long samples = refine_snapshot_cells( t->rf, 2, cell, value ) ;
+        if ( samples >= MIN_SAMPLES ) {
+            if ( ! __atomic_load_n( &t->first, __ATOMIC_RELAXED ) ) {
+                pthread_mutex_lock( &t->lock ) ;
+                __atomic_store_n( &t->first, 1, __ATOMIC_RELAXED ) ;
+                pthread_cond_broadcast( &t->ready ) ;
+                pthread_mutex_unlock( &t->lock ) ;
+            }
+            if ( table_cell_error( value[0], value[1], samples ) <= table_cell_limit( t, worst, target, normal_target ) ) {
+                samples = refine_snapshot( t->rf, chunk ) ;
+                worst = table_short( t, chunk, samples, target, normal_target ) ;
+                done = ( worst == t->cells ) ;
+                if ( ! done ) {
+                    __atomic_store_n( &t->worst, worst, __ATOMIC_RELAXED ) ;
+                }
+            }
+        }
+        free( chunk ) ;
+
+        pthread_mutex_lock( &Pool.lock ) ;
+        if ( done && target == t->target && normal_target == t->normal_target ) {
+            t->done = 1 ;
+        }
+        --t->users ;
+        if ( t->retired ) {
+            pool_sweep() ;
+        }
+    }
+    return NULL ;
+}
+
+static int table_matches( struct table * t, enum norm norm, struct rangelist * powerlist )
+{
+    return ! t->retired && t->norm == norm && t->powers == powerlist->size
+        && memcmp( t->values, powerlist->val, t->powers * sizeof( double ) ) == 0 ;
+}
+
+// Find (or make) the table for this query and have the workers refine it
+// the table is held until pool_release
+//
+// A query with more dimensions than the tables have starts a bigger table,
+// but the smaller ones are kept -- their samples still answer smaller queries.
+// A table is only dropped once a bigger one has caught up with its samples.
+struct table * pool_find( enum norm norm, struct rangelist * powerlist, int dimensions, double target, double normal_target )
+{
+    pthread_mutex_lock( &Pool.lock ) ;
+    struct table * t = NULL ;
+    long most = -1 ;
+    for ( struct table * u = Pool.tables ; u ; u = u->next ) {
+        if ( table_matches( u, norm, powerlist ) && u->dimensions >= dimensions ) {
+            long samples = refine_samples( u->rf ) ;
+            if ( samples > most ) {
+                most = samples ;
+                t = u ;
+            }
+        }
+    }
+    if ( t ) {
+        // tables no bigger and no further along are no more use
+        for ( struct table * u = Pool.tables ; u ; u = u->next ) {
+            if ( u != t && table_matches( u, norm, powerlist ) && u->dimensions <= t->dimensions
+              && refine_samples( u->rf ) <= most ) {
+                pthread_mutex_lock( &u->lock ) ;
+                u->retired = 1 ;
+                pthread_cond_broadcast( &u->ready ) ;
+                pthread_mutex_unlock( &u->lock ) ;
+            }
+        }
+        pool_sweep() ;
+    }
+    if ( t == NULL ) {
+        t = calloc( 1, sizeof( struct table ) ) ;
+        t->norm = norm ;
+        t->dimensions = dimensions ;
+        t->powers = powerlist->size ;
+        t->values = malloc( t->powers * sizeof( double ) ) ;
+        memcpy( t->values, powerlist->val, t->powers * sizeof( double ) ) ;
+        t->target = target ;
+        t->normal_target = normal_target ;
+        pthread_mutex_init( &t->lock, NULL ) ;
+        pthread_cond_init( &t->ready, NULL ) ;
+        t->cells = (size_t) ( dimensions + 1 ) * t->powers ;
+        t->worst = t->powers ; // dimension 1
+        t->rf = refine_init( Workers, 2 * t->cells ) ;
+        t->next = Pool.tables ;
+        Pool.tables = t ;
+        pthread_cond_broadcast( &Pool.work ) ;
+    } else if ( target < t->target || normal_target < t->normal_target ) {
+        t->target = fmin( target, t->target ) ;
+        t->normal_target = fmin( normal_target, t->normal_target ) ;
+        t->done = 0 ;
+        pthread_cond_broadcast( &Pool.work ) ;
+    }
+    ++t->users ;
+    pthread_mutex_unlock( &Pool.lock ) ;
+    return t ;
+}
+
+void pool_release( struct table * t )
+{
+    pthread_mutex_lock( &Pool.lock ) ;
+    --t->users ;
+    if ( t->retired ) {
+        pool_sweep() ;
+    }
+    pthread_mutex_unlock( &Pool.lock ) ;
+}
+
+// Answer one query line into out
+void query( FILE * out, char * line )
+{
+    enum norm norm = NORM_LP ;
+    struct rangelist * powerlist = NULL ;
+    struct rangelist * dimlist = NULL ;
+    double target = DEFAULT_ERROR ;
+    int Normalize = 0 ;
+
+    char * save ;
+    for ( char * word = strtok_r( line, " \t\r\n", &save ) ; word ; word = strtok_r( NULL, " \t\r\n", &save ) ) {
+        if ( strncmp( word, "norm=", 5 ) == 0 ) {
+            if ( strcmp( word+5, "f" ) == 0 ) {
+                norm = NORM_F ;
+            } else if ( strcmp( word+5, "lp" ) == 0 ) {
+                norm = NORM_LP ;
+            } else {
+                fprintf( out, "error: unknown norm %s\n\n", word+5 ) ;
+                goto finish ;
+            }
+        } else if ( strncmp( word, "p=", 2 ) == 0 ) {
+            powerlist = range( word+2 ) ;
+        } else if ( strncmp( word, "d=", 2 ) == 0 ) {
+            dimlist = range( word+2 ) ;
+        } else if ( strncmp( word, "err=", 4 ) == 0 ) {
+            target = atof( word+4 ) ;
+            if ( target <= 0. ) {
+                target = DEFAULT_ERROR ;
+            }
+        } else if ( strncmp( word, "n=", 2 ) == 0 ) {
+            Normalize = atoi( word+2 ) ;
+        } else {
+            fprintf( out, "error: unknown field %s\n\n", word ) ;
+            goto finish ;
+        }
+    }
+    // inf (the max metric) is only in distance_any -- refused, as a dropped column would go unnoticed in the reply
+    if ( powerlist && rangelist_finite( powerlist ) > 0 ) {
+        fprintf( out, "error: inf is for distance_any only\n\n" ) ;
+        goto finish ;
+    }
+    if ( powerlist == NULL ) {
+        powerlist = range( "1_3" ) ;
+    }
+    if ( dimlist == NULL ) {
+        dimlist = range( "1_100" ) ;
+    }
+    int dimensions = 1 ;
+    for ( int i = 0 ; i < dimlist->size ; ++i ) {
+        if ( dimlist->val[i] < 1 || dimlist->val[i] > MAX_DIMENSIONS ) {
+            fprintf( out, "error: d=%g is not 1 to %d\n\n", dimlist->val[i], MAX_DIMENSIONS ) ;
+            goto finish ;
+        }
+        if ( (int) dimlist->val[i] > dimensions ) {
+            dimensions = (int) dimlist->val[i] ;
+        }
+    }
+
+    // wait for a first estimate
+    // (a table dropped meanwhile for a bigger one is no use)
+    struct table * t ;
+    while ( 1 ) {
+        // the target is for the numbers in the reply -- normalized ones are in units of the diagonal
+        t = pool_find( norm, powerlist, dimensions, Normalize ? INFINITY : target, Normalize ? target : INFINITY ) ;
+        pthread_mutex_lock( &t->lock ) ;
+        while ( ! t->first && ! t->retired ) {
+            pthread_cond_wait( &t->ready, &t->lock ) ;
+        }
+        int first = t->first ;
+        pthread_mutex_unlock( &t->lock ) ;
+        if ( first ) {
+            break ;
+        }
+        pool_release( t ) ;
+    }
+
+    // consistent copy of the sums and squares, taken without stopping the workers
+    double * snapshot = malloc( 2 * t->cells * sizeof( double ) ) ;
+    long samples = refine_snapshot( t->rf, snapshot ) ;
+
+    // Title line
+    fprintf( out, "DIM\\Power, " ) ;
+    for ( int ip = 0 ; ip < powerlist->size ; ++ip ) {
+        fprintf( out, "%.2f, err, ", powerlist->val[ip] ) ;
+    }
+    fprintf( out, "\n" ) ;
+
+    for ( int i = 0 ; i < dimlist->size ; ++i ) {
+        int d = (int) dimlist->val[i] ;
+        fprintf( out, "%d, ", d ) ;
+        for ( int ip = 0 ; ip < powerlist->size ; ++ip ) {
+            double mean = snapshot[d*t->powers+ip] / samples ;
+            double error = table_cell_error( snapshot[d*t->powers+ip], snapshot[t->cells+d*t->powers+ip], samples ) ;
+            double scale = 1. ;
+            if ( Normalize ) {
+                scale = ( norm == NORM_F ) ? d : pow( d, 1/powerlist->val[ip] ) ;
+            }
+            fprintf( out, "%g, %.2g, ", mean/scale, error/scale ) ;
+        }
+        fprintf( out, "\n" ) ;
+    }
+    fprintf( out, "\n" ) ;
+    free( snapshot ) ;
+    pool_release( t ) ;
+
+finish:
+    if ( powerlist ) {
+        rangelist_free( powerlist ) ;
+    }
+    if ( dimlist ) {
+        rangelist_free( dimlist ) ;
+    }
+}
+
+// One connection -- any number of query lines
+void * client( void * arg )
+{
+    int fd = (int) (long) arg ;
+    FILE * in = fdopen( fd, "r" ) ;
+    FILE * out = fdopen( dup( fd ), "w" ) ;
+    char * line = NULL ;
+    size_t alloc = 0 ;
+    while ( getline( &line, &alloc, in ) > 0 ) {
+        query( out, line ) ;
+        fflush( out ) ;
+    }
+    free( line ) ;
+    fclose( out ) ;
+    fclose( in ) ;
+    return NULL ;
+}
+
+int main( int argc, char **argv )
+{
+    const char * Socket = "/tmp/distance.sock" ;
+    Workers = sysconf( _SC_NPROCESSORS_ONLN ) ;
+
+    // Arguments
+    int c;
+    while ( (c = getopt( argc, argv, "hu:t:" )) != -1 ) {
+        switch ( c ) {
+        case 'h':
+            help() ;
+            break ;
+        case 'u':
+            Socket = optarg ;
+            break ;
+        case 't':
+            Workers = atoi(optarg);
+            break ;
+        }
+    }
+    if (Workers<1) {
+        Workers = 1 ;
+    }
+
+    // a client hanging up shouldn't stop the server
+    signal( SIGPIPE, SIG_IGN ) ;
+
+    struct sockaddr_un addr ;
+    memset( &addr, 0, sizeof( addr ) ) ;
+    addr.sun_family = AF_UNIX ;
+    if ( strlen( Socket ) >= sizeof( addr.sun_path ) ) {
+        fprintf( stderr, "Socket path %s too long\n", Socket ) ;
+        return 1 ;
+    }
+    strcpy( addr.sun_path, Socket ) ;
+    unlink( Socket ) ;
+    int listener = socket( AF_UNIX, SOCK_STREAM, 0 ) ;
+    if ( listener < 0 || bind( listener, (struct sockaddr *) &addr, sizeof( addr ) ) != 0 || listen( listener, 64 ) != 0 ) {
+        fprintf( stderr, "Cannot listen on %s: %s\n", Socket, strerror( errno ) ) ;
+        return 1 ;
+    }
+
+    // Worker pool
+    for ( long i = 0 ; i < Workers ; ++i ) {
+        pthread_t thread ;
+        pthread_create( &thread, NULL, worker, (void *) i ) ;
+        pthread_detach( thread ) ;
+    }
+
+    // Each connection gets its own thread
+    while ( 1 ) {
+        int fd = accept( listener, NULL, NULL ) ;
+        if ( fd < 0 ) {
+            if ( errno == EINTR ) {
+                continue ;
+            }
+            fprintf( stderr, "Accept failed: %s\n", strerror( errno ) ) ;
+            break ;
+        }
+        pthread_t thread ;
+        pthread_create( &thread, NULL, client, (void *) (long) fd ) ;
+        pthread_detach( thread ) ;
+    }
+
+    close( listener ) ;
+    unlink( Socket ) ;
+    return 0 ;
+}
@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <math.h>
+
+#include "cache.h"
+#include "exact.h"
+#include "domain.h"
+#include "family.h"
+
+void help( void )
+{
+    printf("distance_stitch -- stitch together CSV files from the distance programs\n") ;
+    printf("\tcompiled version of stitch.py for large files\n");
+    printf("\n");
+    printf("By Paul H Alfille 2021 -- MIT license\n") ;
+    printf("\n");
+    printf("Files are joined width-wise:\n");
+    printf("\tthe first column (dimension) is taken from the first file only\n");
+    printf("\theader names are prefixed with each file's name\n");
+    printf("\toutput stops at the end of the shortest file\n");
+    printf("\n");
+    printf("Syntax:\n");
+    printf("\tdistance_stitch [options] file.csv [file2.csv ...]\n");
+    printf("\t\"-\" reads standard input\n");
+    printf("\tresult cache files (distance -C) are read as the CSV the program would print\n");
+    printf("Options:\n");
+    printf("\t-s \"::10\"\tpython format slice of data columns (not the first column)\n");
+    printf("\t\te.g. \"::2\" for every other power. Last column always included\n");
+    printf("\t-n\tnormalize cache files (to the longest diagonal of their domain)\n");
+    printf("\t-h\tthis help\n");
+    exit(0) ;
+}
+
+// release mapped input in pieces this size (multiple of page size)
+#define DROP_CHUNK (16<<20)
+
+// One input file, mapped into memory and read a line at a time
+struct csvfile {
+    char * name ; // basename without extension
+    char * data ;
+    size_t size ;
+    size_t pos ; // start of next line
+    size_t dropped ; // mapped pages before this already released
+    int mapped ; // mmap (or malloc for stdin)
+    int length ; // columns, not counting an empty trailing one
+    int firstcol ; // keep first column (first file only)
+    int lastcol ; // add last column (not in slice)
+    int selected ; // number of sliced data columns
+    int * columns ; // sliced data column indexes
+} ;
+
+// Field boundaries within the current line
+struct fields {
+    int count ;
+    int alloc ;
+    const char ** start ;
+    int * len ;
+} ;
+
+// Print a result cache file as its program would (see cache.h)
+// into memory. Returns 0 if it was a cache file, -1 if one that can't be shown.
+int cache_csv( struct csvfile * cf, const char * path, int Normalize )
+{
+    struct cache_entry ce ;
+    memset( &ce, 0, sizeof( ce ) ) ;
+    if ( cache_read( path, &ce ) != 0 ) {
+        return 1 ;
+    }
+    int fnorm = ( strcmp( ce.kind, "distance_f" ) == 0 ) ; // no root
+    int Domain = domain_parse( ce.domain ) ;
+    if ( Domain < 0 ) {
+        fprintf( stderr, "%s: unknown domain %s\n", path, ce.domain ) ;
+        cache_free( &ce ) ;
+        return -1 ;
+    }
+    // only the cube has exact low dimensions
+    int exact = ( Domain == DOMAIN_CUBE ) ? ce.exact : 0 ;
+
+    // longest segments for -n, as the programs normalize
+    // (small p in logs, canberra and angular their own -- as distance_any)
+    double (*diagonal)[ce.powers] = malloc( ( ce.dimensions+1 ) * sizeof( *diagonal ) ) ;
+    double (*log_diagonal)[ce.powers] = malloc( ( ce.dimensions+1 ) * sizeof( *log_diagonal ) ) ;
+    domain_diagonals( Domain, ce.dimensions, ce.powers, ce.values, NULL, &diagonal[0][0], &log_diagonal[0][0] ) ;
+
+    char label[32] ;
+    FILE * out = open_memstream( &cf->data, &cf->size ) ;
+    fprintf( out, "DIM\\Power, " ) ;
+    for ( int ip = 0 ; ip < ce.powers ; ++ip ) {
+        if ( strcmp( ce.kind, "distance" ) == 0 ) {
+            fprintf( out, "%d, ", (int) ce.values[ip] ) ;
+        } else if ( fnorm ) {
+            fprintf( out, "%.2f, ", ce.values[ip] ) ;
+        } else {
+            family_label( label, sizeof( label ), ce.values[ip] ) ;
+            fprintf( out, "%s, ", label ) ;
+        }
+    }
+    fprintf( out, "\n" ) ;
+    for ( int d = 1 ; d <= ce.dimensions ; ++d ) {
+        fprintf( out, "%d, ", d ) ;
+        for ( int ip = 0 ; ip < ce.powers ; ++ip ) {
+            // factor from a length in the totals to the printed value
+            double p = ce.values[ip] ;
+            double unit = 1. ;
+            if ( fnorm ) {
+                unit = Normalize ? pow( diagonal[d][ip], -p ) : 1. ;
+            } else {
+                switch ( family_of( p ) ) {
+                case FAMILY_SMALL_P:
+                    // totals are in units of d^(1/p)
+                    unit = exp( log( d ) / p - ( Normalize ? log_diagonal[d][ip] : 0. ) ) ;
+                    break ;
+                case FAMILY_CANBERRA:
+                    unit = Normalize ? 1. / d : 1. ;
+                    break ;
+                case FAMILY_ANGULAR:
+                    unit = Normalize ? 1. / ( ( Domain == DOMAIN_CUBE || Domain == DOMAIN_TORUS || Domain == DOMAIN_SIMPLEX ) ? M_PI_2 : M_PI ) : 1. ;
+                    break ;
+                default:
+                    unit = Normalize ? 1. / diagonal[d][ip] : 1. ;
+                    break ;
+                }
+            }
+            if ( d <= exact ) {
+                double length = fnorm ? exact_fnorm( d, p ) : exact_length( d, p ) ;
+                fprintf( out, "%.15g, ", length * unit ) ;
+            } else {
+                fprintf( out, "%g, ", ce.totals[d*ce.powers+ip] / ce.samples * unit ) ;
+            }
+        }
+        fprintf( out, "\n" ) ;
+    }
+    fclose( out ) ;
+    free( diagonal ) ;
+    free( log_diagonal ) ;
+    cache_free( &ce ) ;
+    return 0 ;
+}
+
+// Map the file (or read all of stdin, which can't be mapped)
+int csv_open( struct csvfile * cf, const char * path, int Normalize )
+{
+    int cached = 1 ;
+    if ( strcmp( path, "-" ) == 0 ) {
+        size_t alloc = 1<<20 ;
+        cf->data = malloc( alloc ) ;
+        cf->size = 0 ;
+        size_t got ;
+        while ( (got = fread( cf->data + cf->size, 1, alloc - cf->size, stdin )) > 0 ) {
+            cf->size += got ;
+            if ( cf->size == alloc ) {
+                alloc *= 2 ;
+                cf->data = realloc( cf->data, alloc ) ;
+            }
+        }
+        cf->mapped = 0 ;
+    } else if ( (cached = cache_csv( cf, path, Normalize )) <= 0 ) {
+        if ( cached < 0 ) {
+            return 1 ;
+        }
+        cf->mapped = 0 ;
+    } else {
+        int fd = open( path, O_RDONLY ) ;
+        if ( fd < 0 ) {
+            fprintf( stderr, "Cannot open %s\n", path ) ;
+            return 1 ;
+        }
+        struct stat st ;
+        fstat( fd, &st ) ;
+        cf->size = st.st_size ;
+        cf->data = NULL ;
+        if ( cf->size > 0 ) {
+            cf->data = mmap( NULL, cf->size, PROT_READ, MAP_PRIVATE, fd, 0 ) ;
+            if ( cf->data == MAP_FAILED ) {
+                fprintf( stderr, "Cannot map %s\n", path ) ;
+                close( fd ) ;
+                return 1 ;
+            }
+            madvise( cf->data, cf->size, MADV_SEQUENTIAL ) ;
+        }
+        close( fd ) ;
+        cf->mapped = 1 ;
+    }
+
+    if ( strcmp( path, "-" ) == 0 ) {
+        cf->name = strdup( "-" ) ;
+    } else {
+        // basename without extension -- as stitch.py
+        const char * base = strrchr( path, '/' ) ;
+        base = base ? base+1 : path ;
+        cf->name = strdup( base ) ;
+        char * dot = strrchr( cf->name, '.' ) ;
+        if ( dot && dot != cf->name ) {
+            *dot = '\0' ;
+        }
+    }
+    cf->pos = 0 ;
+    cf->dropped = 0 ;
+    return 0 ;
+}
+
+void csv_close( struct csvfile * cf )
+{
+    if ( cf->mapped ) {
+        if ( cf->size > 0 ) {
+            munmap( cf->data, cf->size ) ;
+        }
+    } else {
+        free( cf->data ) ;
+    }
+    free( cf->name ) ;
+    free( cf->columns ) ;
+}
+
+// Split the next line into fields (quotes protect commas)
+// returns 0 at end of file
+int csv_next( struct csvfile * cf, struct fields * fl )
+{
+    if ( cf->pos >= cf->size ) {
+        return 0 ;
+    }
+    const char * p = cf->data + cf->pos ;
+    const char * end = cf->data + cf->size ;
+    const char * eol = memchr( p, '\n', end - p ) ;
+    if ( eol == NULL ) {
+        eol = end ;
+    }
+    cf->pos = ( eol - cf->data ) + 1 ;
+
+    // release pages already read so memory stays flat for huge files
+    if ( cf->mapped && cf->pos - cf->dropped > DROP_CHUNK ) {
+        size_t upto = ( cf->pos - DROP_CHUNK/2 ) & ~( (size_t) DROP_CHUNK/2 - 1 ) ;
+        madvise( cf->data + cf->dropped, upto - cf->dropped, MADV_DONTNEED ) ;
+        cf->dropped = upto ;
+    }
+    const char * stop = eol ;
+    if ( stop > p && stop[-1] == '\r' ) {
+        --stop ;
+    }
+
+    // as python's csv.reader: only a field starting with a quote is quoted,
+    // until the next lone quote ("" inside stands for one quote)
+    fl->count = 0 ;
+    const char * f = p ;
+    int quoted = ( p < stop && *p == '"' ) ;
+    for ( const char * c = p + quoted ; ; ++c ) {
+        if ( quoted ) {
+            if ( c == stop ) {
+                quoted = 0 ; // unterminated -- ends with the line
+            } else if ( *c == '"' ) {
+                if ( c + 1 < stop && c[1] == '"' ) {
+                    ++c ;
+                } else {
+                    quoted = 0 ;
+                }
+                continue ;
+            } else {
+                continue ;
+            }
+        }
+        if ( c == stop || *c == ',' ) {
+            if ( fl->count == fl->alloc ) {
+                fl->alloc = fl->alloc ? 2 * fl->alloc : 256 ;
+                fl->start = realloc( fl->start, fl->alloc * sizeof( const char * ) ) ;
+                fl->len = realloc( fl->len, fl->alloc * sizeof( int ) ) ;
+            }
+            fl->start[fl->count] = f ;
+            fl->len[fl->count] = c - f ;
+            ++fl->count ;
+            if ( c == stop ) {
+                break ;
+            }
+            f = c + 1 ;
+            quoted = ( f < stop && *f == '"' ) ;
+            if ( quoted ) {
+                ++c ;
+            }
+        }
+    }
+    return 1 ;
+}
+
+// Python slice semantics for "start:stop:step" over n items
+// fills idx with the chosen indexes, returns how many
+int slice_indexes( const char * slice, int n, int * idx )
+{
+    long v[3] ;
+    int given[3] = { 0, 0, 0 } ;
+    const char * s = slice ;
+    for ( int i = 0 ; i < 3 ; ++i ) {
+        char * endp ;
+        v[i] = strtol( s, &endp, 10 ) ;
+        given[i] = ( endp != s ) ;
+        s = strchr( endp, ':' ) ;
+        if ( s == NULL ) {
+            break ;
+        }
+        ++s ;
+    }
+
+    long step = given[2] ? v[2] : 1 ;
+    if ( step == 0 ) {
+        step = 1 ;
+    }
+    long start, stop ;
+    if ( step > 0 ) {
+        start = given[0] ? v[0] : 0 ;
+        stop = given[1] ? v[1] : n ;
+        if ( start < 0 ) start += n ;
+        if ( stop < 0 ) stop += n ;
+        if ( start < 0 ) start = 0 ;
+        if ( start > n ) start = n ;
+        if ( stop < 0 ) stop = 0 ;
+        if ( stop > n ) stop = n ;
+    } else {
+        start = given[0] ? v[0] : n-1 ;
+        stop = given[1] ? v[1] : -n-1 ;
+        if ( start < 0 ) start += n ;
+        if ( given[1] && stop < 0 ) stop += n ;
+        if ( start < -1 ) start = -1 ;
+        if ( start > n-1 ) start = n-1 ;
+        if ( stop < -1 ) stop = -1 ;
+        if ( stop > n-1 ) stop = n-1 ;
+    }
+
+    int count = 0 ;
+    for ( long i = start ; step > 0 ? i < stop : i > stop ; i += step ) {
+        idx[count++] = (int) i ;
+    }
+    return count ;
+}
+
+// Use the header line to size the columns and apply the slice
+void csv_columns( struct csvfile * cf, struct fields * header, const char * slice, int firstcol )
+{
+    cf->length = header->count ;
+    // empty last element (trailing comma) removed here and all lines
+    if ( cf->length > 0 ) {
+        int empty = 1 ;
+        for ( int i = 0 ; i < header->len[cf->length-1] ; ++i ) {
+            if ( header->start[cf->length-1][i] != ' ' && header->start[cf->length-1][i] != '\t' ) {
+                empty = 0 ;
+            }
+        }
+        if ( empty ) {
+            --cf->length ;
+        }
+    }
+    cf->firstcol = firstcol ;
+
+    int n = cf->length > 1 ? cf->length - 1 : 0 ;
+    cf->columns = malloc( ( n + 1 ) * sizeof( int ) ) ;
+    cf->selected = slice_indexes( slice, n, cf->columns ) ;
+    for ( int i = 0 ; i < cf->selected ; ++i ) {
+        cf->columns[i] += 1 ; // skip first column
+    }
+
+    // If slice does not include last element, add it on.
+    cf->lastcol = ( n > 0 ) && ( cf->selected == 0 || cf->columns[cf->selected-1] < cf->length-1 ) ;
+}
+
+// write one field, with a separating comma if not first on the line
+// quotes are taken off as csv.reader does (stitch.py writes the values bare)
+void put_field( const char * start, int len, int * first )
+{
+    if ( ! *first ) {
+        putchar_unlocked( ',' ) ;
+    }
+    *first = 0 ;
+    if ( len == 0 || start[0] != '"' ) {
+        fwrite_unlocked( start, 1, len, stdout ) ;
+        return ;
+    }
+    int i ;
+    for ( i = 1 ; i < len ; ++i ) {
+        if ( start[i] == '"' ) {
+            if ( i + 1 < len && start[i+1] == '"' ) {
+                ++i ; // "" is one quote
+            } else {
+                break ; // closing quote -- the rest is as it stands
+            }
+        }
+        putchar_unlocked( start[i] ) ;
+    }
+    if ( i + 1 < len ) {
+        fwrite_unlocked( start + i + 1, 1, len - i - 1, stdout ) ;
+    }
+}
+
+// header fields become "name" + field (quotes removed)
+void put_header( const char * name, const char * start, int len, int * first )
+{
+    if ( ! *first ) {
+        putchar_unlocked( ',' ) ;
+    }
+    *first = 0 ;
+    putchar_unlocked( '"' ) ;
+    fputs( name, stdout ) ;
+    for ( int i = 0 ; i < len ; ++i ) {
+        if ( start[i] != '"' ) {
+            putchar_unlocked( start[i] ) ;
+        }
+    }
+    putchar_unlocked( '"' ) ;
+}
+
+// Sliced fields of one file's current line
+void put_row( struct csvfile * cf, struct fields * fl, int * first, int header )
+{
+    for ( int i = 0 ; i < cf->selected + cf->firstcol + cf->lastcol ; ++i ) {
+        int col ;
+        if ( cf->firstcol && i == 0 ) {
+            col = 0 ;
+        } else if ( i - cf->firstcol < cf->selected ) {
+            col = cf->columns[i - cf->firstcol] ;
+        } else {
+            col = cf->length - 1 ;
+        }
+        const char * start = col < fl->count ? fl->start[col] : "" ;
+        int len = col < fl->count ? fl->len[col] : 0 ;
+        if ( header ) {
+            put_header( cf->name, start, len, first ) ;
+        } else {
+            put_field( start, len, first ) ;
+        }
+    }
+}
+
+int main( int argc, char **argv )
+{
+    const char * Slice = "::" ;
+    int Normalize = 0 ;
+
+    // Arguments
+    int c;
+    while ( (c = getopt( argc, argv, "hs:n" )) != -1 ) {
+        switch ( c ) {
+        case 'h':
+            help() ;
+            break ;
+        case 's':
+            Slice = optarg ;
+            break ;
+        case 'n':
+            Normalize = 1 ;
+            break ;
+        }
+    }
+
+    int Files = argc - optind ;
+    if ( Files < 1 ) {
+        fprintf( stderr, "At least one CSV file is needed (-h for help)\n" ) ;
+        return 1 ;
+    }
+
+    struct csvfile cf[Files] ;
+    struct fields fl[Files] ;
+    memset( cf, 0, sizeof( cf ) ) ;
+    memset( fl, 0, sizeof( fl ) ) ;
+    for ( int f = 0 ; f < Files ; ++f ) {
+        if ( csv_open( &cf[f], argv[optind+f], Normalize ) != 0 ) {
+            return 1 ;
+        }
+    }
+
+    // big output buffer -- the output is streamed, never held
+    static char outbuf[1<<20] ;
+    setvbuf( stdout, outbuf, _IOFBF, sizeof( outbuf ) ) ;
+
+    // Header line sets up each file's columns
+    int first = 1 ;
+    for ( int f = 0 ; f < Files ; ++f ) {
+        if ( csv_next( &cf[f], &fl[f] ) == 0 ) {
+            fprintf( stderr, "%s is empty\n", argv[optind+f] ) ;
+            return 1 ;
+        }
+        csv_columns( &cf[f], &fl[f], Slice, f == 0 ) ;
+        put_row( &cf[f], &fl[f], &first, 1 ) ;
+    }
+    putchar_unlocked( '\n' ) ;
+
+    // Data lines until the shortest file runs out
+    while ( 1 ) {
+        int f ;
+        for ( f = 0 ; f < Files ; ++f ) {
+            if ( csv_next( &cf[f], &fl[f] ) == 0 ) {
+                break ;
+            }
+        }
+        if ( f < Files ) {
+            break ;
+        }
+        first = 1 ;
+        for ( f = 0 ; f < Files ; ++f ) {
+            put_row( &cf[f], &fl[f], &first, 0 ) ;
+        }
+        putchar_unlocked( '\n' ) ;
+    }
+
+    for ( int f = 0 ; f < Files ; ++f ) {
+        csv_close( &cf[f] ) ;
+        free( fl[f].start ) ;
+        free( fl[f].len ) ;
+    }
+
+    // success
+    return 0 ;
+}
@@ -0,0 +1,608 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "rangelist.h"
+#include "domain.h"
+#include "family.h"
+#include "place.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// A sweep: many configurations (norm, powers, dimensions, domain) from a job
+// file, run on one pool of threads instead of one program after another.
+//
+// Every job is cut into chunks of about SWEEP_WORK length evaluations, so a
+// cheap job is a few chunks and an expensive one many, all about the same
+// size. The chunks are dealt in job order to the workers' deques; a worker
+// takes from the front of its own deque, and when that is empty steals from
+// the back of the fullest other one. Nobody idles while any chunk is left,
+// whatever the jobs cost.
+//
+// Each chunk has its own random stream, seeded from (seed, job, chunk), and
+// the chunks don't depend on the thread count, so a job's result is the same
+// (but for the order the chunks are added) however it was shared out.
+// The worker that adds in a job's last chunk writes its output file
+// (to a temporary name, then renamed) -- results appear as jobs finish.
+
+#define SWEEP_WORK 2000000 // length evaluations (samples x dimensions x powers) per chunk
+#define SWEEP_CHUNKS 64 // and at least this many chunks of a job (samples allowing), to share it out
+#define DEFAULT_SAMPLES 1000000
+
+void help( void )
+{
+    printf("distance_sweep -- run many average distance configurations from a job file\n") ;
+    printf("\ton one pool of threads, writing each result as it finishes.\n");
+    printf("\n");
+    printf("By Paul H Alfille 2021 -- MIT license\n") ;
+    printf("\n");
+    printf("Syntax:\n");
+    printf("\tdistance_sweep [options] jobs.txt\t(- for standard input)\n");
+    printf("Options:\n");
+    printf("\t-t 4\tworker threads (default one per processor)\n");
+    printf("\t-o dir\tdirectory for outputs without o= (default .)\n");
+    printf("\t-S 42\trandom seed (default from the clock)\n");
+    printf("\t-h\tthis help\n");
+    printf("\n");
+    printf("One job a line (# starts a comment), fields as distance_served queries:\n");
+    printf("\tnorm=lp p=1_3 d=1_100 r=1000000 n=1 domain=cube o=lp.csv\n");
+    printf("\t\tnorm\tlp (as distance_any, default) or f (as distance_f)\n");
+    printf("\t\tp\tpowers, same syntax as distance_any -p (default 1_3)\n");
+    printf("\t\tk\tcanberra and/or angular columns too (lp only, as distance_any -k)\n");
+    printf("\t\td\tdimensions, same syntax (default 1_100)\n");
+    printf("\t\tr\trandom samples (default 1000000)\n");
+    printf("\t\tn\t1 to normalize (to longest diagonal)\n");
+    printf("\t\tdomain\tcube, torus or gaussian (default cube)\n");
+    printf("\t\to\toutput CSV file (default jobLINE.csv in -o dir)\n");
+    printf("Progress and the total time against the work done are on stderr\n");
+    exit(0) ;
+}
+
+enum norm { NORM_LP, NORM_F } ;
+
+// One line of the job file
+struct job {
+    int line ;
+    int index ; // among the jobs (for the random streams)
+    enum norm norm ;
+    enum domain Domain ;
+    int Normalize ;
+    struct rangelist * powerlist ;
+    struct rangelist * dimlist ;
+    enum family * family ;
+    int dimensions ; // largest in dimlist
+    size_t cells ; // (dimensions+1) x powers
+    long samples ;
+    char * output ;
+
+    // filled in by the chunks
+    pthread_mutex_t lock ;
+    int remaining ; // chunks not yet added in
+    double * totals ;
+    double work ; // processor seconds
+} ;
+
+// Some samples of one job
+struct task {
+    struct job * job ;
+    int chunk ;
+    long samples ;
+} ;
+
+// A worker's chunks -- it takes from the front, thieves from the back
+struct deque {
+    pthread_mutex_t lock ;
+    struct task * task ;
+    int head ; // [head,tail) still to do
+    int tail ;
+} __attribute__(( aligned( 64 ) )) ; // own cache line -- no false sharing
+
+struct sweep {
+    int workers ;
+    struct deque * deques ;
+    struct place * place ;
+    unsigned long long seed ;
+    struct timespec start ;
+} ;
+
+struct worker {
+    pthread_t thread ;
+    int id ;
+    struct sweep * sweep ;
+} ;
+
+static double seconds_since( struct timespec * start )
+{
+    struct timespec now ;
+    clock_gettime( CLOCK_MONOTONIC, &now ) ;
+    return ( now.tv_sec - start->tv_sec ) + 1.e-9 * ( now.tv_nsec - start->tv_nsec ) ;
+}
+
+static double thread_seconds( void )
+{
+    struct timespec now ;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now ) ;
+    return now.tv_sec + 1.e-9 * now.tv_nsec ;
+}
+
+// splitmix64 -- well mixed seeds from consecutive numbers
+static unsigned long long mix( unsigned long long z )
+{
+    z += 0x9E3779B97F4A7C15ULL ;
+    z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL ;
+    z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL ;
+    return z ^ ( z >> 31 ) ;
+}
+
+// Both coordinates of a separable domain and their difference
+static inline void sweep_coords( enum domain Domain, unsigned short rng[3], double * x, double * y, double * dx )
+{
+    if ( Domain == DOMAIN_GAUSSIAN ) {
+        // Box-Muller, one pair for the two points
+        double radius = sqrt( -2. * log( 1. - erand48( rng ) ) ) ;
+        double angle = 2. * M_PI * erand48( rng ) ;
+        *x = radius * cos( angle ) ;
+        *y = radius * sin( angle ) ;
+    } else {
+        *x = erand48( rng ) ;
+        *y = erand48( rng ) ;
+    }
+    *dx = fabs( *x - *y ) ;
+    if ( Domain == DOMAIN_TORUS && *dx > .5 ) {
+        *dx = 1. - *dx ;
+    }
+}
+
+// Add Samples random segments of the job to totals
+// running sums one dimension at a time as in distance_any -s
+static void sample_chunk( struct job * job, long Samples, unsigned short rng[3], double * totals )
+{
+    int Dimensions = job->dimensions ;
+    int Powers = job->powerlist->size ;
+    enum domain Domain = job->Domain ;
+    double val[Powers] ;
+    enum family family[Powers] ;
+    for ( int ip = 0 ; ip < Powers ; ++ip ) {
+        val[ip] = job->powerlist->val[ip] ;
+        // the f-norm is the Lp running sum without the root
+        family[ip] = ( job->norm == NORM_F ) ? FAMILY_LP : job->family[ip] ;
+    }
+    int root = ( job->norm == NORM_LP ) ;
+    double running[Powers] ;
+
+    for ( long r = 0 ; r < Samples ; ++r ) {
+        double xx = 0. ;
+        double yy = 0. ;
+        for ( int ip = 0 ; ip < Powers ; ++ip ) {
+            running[ip] = 0. ;
+        }
+        for ( int d = 1 ; d <= Dimensions ; ++d ) {
+            double x, y, dx ;
+            sweep_coords( Domain, rng, &x, &y, &dx ) ;
+            xx += x * x ;
+            yy += y * y ;
+
+            // update the running value for each power
+            for ( int ip = 0 ; ip < Powers ; ++ip ) {
+                running[ip] = family_add( family[ip], val[ip], running[ip], dx, x, y ) ;
+            }
+
+            // and this dimension's lengths to the totals
+            double * row = &totals[d*Powers] ;
+            if ( root ) {
+                for ( int ip = 0 ; ip < Powers ; ++ip ) {
+                    row[ip] += family_length( family[ip], val[ip], running[ip], d, xx, yy ) ;
+                }
+            } else {
+                for ( int ip = 0 ; ip < Powers ; ++ip ) {
+                    row[ip] += running[ip] ;
+                }
+            }
+        }
+    }
+}
+
+// The finished job's table, as distance_any or distance_f would print it
+static int job_write( struct job * job )
+{
+    int Powers = job->powerlist->size ;
+    const double * val = job->powerlist->val ;
+    char temporary[strlen( job->output ) + 8] ;
+    snprintf( temporary, sizeof( temporary ), "%s.part", job->output ) ;
+    FILE * out = fopen( temporary, "w" ) ;
+    if ( out == NULL ) {
+        fprintf( stderr, "Line %d: cannot write %s\n", job->line, temporary ) ;
+        return 1 ;
+    }
+
+    // longest segments for -n (as distance_any: small p in logs, canberra and angular their own)
+    double (*diagonal)[Powers] = malloc( ( job->dimensions+1 ) * sizeof( *diagonal ) ) ;
+    double (*log_diagonal)[Powers] = malloc( ( job->dimensions+1 ) * sizeof( *log_diagonal ) ) ;
+    domain_diagonals( job->Domain, job->dimensions, Powers, val, NULL, &diagonal[0][0], &log_diagonal[0][0] ) ;
+
+    char label[32] ;
+    fprintf( out, "DIM\\Power, " ) ;
+    for ( int ip = 0 ; ip < Powers ; ++ip ) {
+        family_label( label, sizeof( label ), val[ip] ) ;
+        fprintf( out, "%s, ", label ) ;
+    }
+    fprintf( out, "\n" ) ;
+
+    for ( int i = 0 ; i < job->dimlist->size ; ++i ) {
+        int d = (int) job->dimlist->val[i] ;
+        fprintf( out, "%d, ", d ) ;
+        for ( int ip = 0 ; ip < Powers ; ++ip ) {
+            double unit = 1. ;
+            if ( job->norm == NORM_F ) {
+                unit = job->Normalize ? pow( diagonal[d][ip], -val[ip] ) : 1. ;
+            } else {
+                switch ( job->family[ip] ) {
+                case FAMILY_SMALL_P:
+                    unit = exp( log( d ) / val[ip] - ( job->Normalize ? log_diagonal[d][ip] : 0. ) ) ;
+                    break ;
+                case FAMILY_CANBERRA:
+                    unit = job->Normalize ? 1. / d : 1. ;
+                    break ;
+                case FAMILY_ANGULAR:
+                    unit = job->Normalize ? 1. / ( ( job->Domain == DOMAIN_GAUSSIAN ) ? M_PI : M_PI_2 ) : 1. ;
+                    break ;
+                default:
+                    unit = job->Normalize ? 1. / diagonal[d][ip] : 1. ;
+                    break ;
+                }
+            }
+            fprintf( out, "%g, ", job->totals[d*Powers+ip] / job->samples * unit ) ;
+        }
+        fprintf( out, "\n" ) ;
+    }
+    free( diagonal ) ;
+    free( log_diagonal ) ;
+
+    if ( fclose( out ) != 0 || rename( temporary, job->output ) != 0 ) {
+        fprintf( stderr, "Line %d: cannot write %s\n", job->line, job->output ) ;
+        return 1 ;
+    }
+    return 0 ;
+}
+
+// Next chunk: own deque first, else steal from the fullest
+static int sweep_take( struct sweep * s, int id, struct task * task )
+{
+    struct deque * own = &s->deques[id] ;
+    pthread_mutex_lock( &own->lock ) ;
+    if ( own->head < own->tail ) {
+        // stored atomically for the lock-free glance below
+        *task = own->task[own->head] ;
+        __atomic_store_n( &own->head, own->head + 1, __ATOMIC_RELAXED ) ;
+        pthread_mutex_unlock( &own->lock ) ;
+        return 1 ;
+    }
+    pthread_mutex_unlock( &own->lock ) ;
+
+    while ( 1 ) {
+        // a glance without locks to pick the victim, then check under its lock
+        int victim = -1 ;
+        int most = 0 ;
+        for ( int v = 0 ; v < s->workers ; ++v ) {
+            int left = __atomic_load_n( &s->deques[v].tail, __ATOMIC_RELAXED ) - __atomic_load_n( &s->deques[v].head, __ATOMIC_RELAXED ) ;
+            if ( left > most ) {
+                most = left ;
+                victim = v ;
+            }
+        }
+        if ( victim < 0 ) {
+            return 0 ; // no chunks left anywhere -- none are ever added
+        }
+        struct deque * other = &s->deques[victim] ;
+        pthread_mutex_lock( &other->lock ) ;
+        if ( other->head < other->tail ) {
+            __atomic_store_n( &other->tail, other->tail - 1, __ATOMIC_RELAXED ) ;
+            *task = other->task[other->tail] ;
+            pthread_mutex_unlock( &other->lock ) ;
+            return 1 ;
+        }
+        pthread_mutex_unlock( &other->lock ) ;
+    }
+}
+
+void * sweep_thread( void * arg )
+{
+    struct worker * w = arg ;
+    struct sweep * s = w->sweep ;
+    place_pin( s->place, w->id ) ;
+
+    struct task task ;
+    while ( sweep_take( s, w->id, &task ) ) {
+        struct job * job = task.job ;
+        double begin = thread_seconds() ;
+
+        unsigned long long z = mix( s->seed ^ mix( ( (unsigned long long) job->index << 32 ) + task.chunk ) ) ;
+        unsigned short rng[3] = { (unsigned short) z, (unsigned short) ( z >> 16 ), (unsigned short) ( z >> 32 ) } ;
+        double * totals = calloc( job->cells, sizeof( double ) ) ;
+        sample_chunk( job, task.samples, rng, totals ) ;
+
+        pthread_mutex_lock( &job->lock ) ;
+        for ( size_t i = 0 ; i < job->cells ; ++i ) {
+            job->totals[i] += totals[i] ;
+        }
+        job->work += thread_seconds() - begin ;
+        int last = ( --job->remaining == 0 ) ;
+        pthread_mutex_unlock( &job->lock ) ;
+        free( totals ) ;
+
+        if ( last ) {
+            // every other chunk is in -- only this thread touches the job now
+            if ( job_write( job ) == 0 ) {
+                fprintf( stderr, "line %d done at %.2f s (work %.2f s) -> %s\n", job->line, seconds_since( &s->start ), job->work, job->output ) ;
+            }
+        }
+    }
+    return NULL ;
+}
+
+// Parse one job line (already without its comment), 0 if there is no job
+// -1 for a bad field (with a message)
+static int job_parse( struct job * job, char * text, int line, const char * Directory )
+{
+    memset( job, 0, sizeof( *job ) ) ;
+    job->line = line ;
+    job->norm = NORM_LP ;
+    job->Domain = DOMAIN_CUBE ;
+    job->samples = DEFAULT_SAMPLES ;
+    const char * Kinds = NULL ;
+    int fields = 0 ;
+
+    char * save ;
+    for ( char * word = strtok_r( text, " \t\r\n", &save ) ; word ; word = strtok_r( NULL, " \t\r\n", &save ) ) {
+        ++fields ;
+        if ( strncmp( word, "norm=", 5 ) == 0 ) {
+            if ( strcmp( word+5, "f" ) == 0 ) {
+                job->norm = NORM_F ;
+            } else if ( strcmp( word+5, "lp" ) == 0 ) {
+                job->norm = NORM_LP ;
+            } else {
+                fprintf( stderr, "Line %d: unknown norm %s\n", line, word+5 ) ;
+                return -1 ;
+            }
+        } else if ( strncmp( word, "p=", 2 ) == 0 ) {
+            if ( job->powerlist ) {
+                rangelist_free( job->powerlist ) ;
+            }
+            job->powerlist = range( word+2 ) ;
+        } else if ( strncmp( word, "k=", 2 ) == 0 ) {
+            Kinds = word+2 ;
+        } else if ( strncmp( word, "d=", 2 ) == 0 ) {
+            if ( job->dimlist ) {
+                rangelist_free( job->dimlist ) ;
+            }
+            job->dimlist = range( word+2 ) ;
+        } else if ( strncmp( word, "r=", 2 ) == 0 ) {
+            job->samples = (long) atof( word+2 ) ;
+            if ( job->samples < 1 ) {
+                job->samples = 1 ;
+            }
+        } else if ( strncmp( word, "n=", 2 ) == 0 ) {
+            job->Normalize = atoi( word+2 ) ;
+        } else if ( strncmp( word, "domain=", 7 ) == 0 ) {
+            int domain = domain_parse( word+7 ) ;
+            if ( domain < 0 || ! domain_separable( domain ) ) {
+                fprintf( stderr, "Line %d: domain %s -- cube, torus or gaussian only\n", line, word+7 ) ;
+                return -1 ;
+            }
+            job->Domain = domain ;
+        } else if ( strncmp( word, "o=", 2 ) == 0 ) {
+            job->output = strdup( word+2 ) ;
+        } else {
+            fprintf( stderr, "Line %d: unknown field %s\n", line, word ) ;
+            return -1 ;
+        }
+    }
+    if ( fields == 0 ) {
+        return 0 ;
+    }
+
+    if ( job->powerlist == NULL ) {
+        job->powerlist = range( "1_3" ) ;
+    }
+    if ( Kinds ) {
+        if ( job->norm == NORM_F ) {
+            fprintf( stderr, "Line %d: k= is for norm=lp only\n", line ) ;
+            return -1 ;
+        }
+        char kinds[strlen( Kinds )+1] ;
+        strcpy( kinds, Kinds ) ;
+        char * ksave ;
+        for ( char * k = strtok_r( kinds, ",", &ksave ) ; k ; k = strtok_r( NULL, ",", &ksave ) ) {
+            double value = family_parse( k ) ;
+            if ( value == 0. ) {
+                fprintf( stderr, "Line %d: unknown kind %s -- canberra or angular\n", line, k ) ;
+                return -1 ;
+            }
+            rangelist_add( value, job->powerlist ) ;
+        }
+    }
+    if ( job->norm == NORM_F && rangelist_finite( job->powerlist ) > 0 ) {
+        fprintf( stderr, "Line %d: the f-norm has no inf -- left out\n", line ) ;
+    }
+    if ( job->powerlist->size == 0 ) {
+        fprintf( stderr, "Line %d: no powers\n", line ) ;
+        return -1 ;
+    }
+    if ( job->dimlist == NULL ) {
+        job->dimlist = range( "1_100" ) ;
+    }
+    job->dimensions = 1 ;
+    for ( int i = 0 ; i < job->dimlist->size ; ++i ) {
+        if ( (int) job->dimlist->val[i] > job->dimensions ) {
+            job->dimensions = (int) job->dimlist->val[i] ;
+        }
+    }
+    if ( job->output == NULL ) {
+        size_t size = strlen( Directory ) + 32 ;
+        job->output = malloc( size ) ;
+        snprintf( job->output, size, "%s/job%d.csv", Directory, line ) ;
+    }
+    job->family = malloc( job->powerlist->size * sizeof( enum family ) ) ;
+    for ( int ip = 0 ; ip < job->powerlist->size ; ++ip ) {
+        job->family[ip] = family_of( job->powerlist->val[ip] ) ;
+    }
+    job->cells = (size_t) ( job->dimensions + 1 ) * job->powerlist->size ;
+    return 1 ;
+}
+
+int main( int argc, char **argv )
+{
+    int Workers = 0 ; // 0 for one per processor
+    const char * Directory = "." ;
+    unsigned long long Seed = 0 ; // 0 for seeded from the clock
+
+    // Arguments
+    int c;
+    while ( (c = getopt( argc, argv, "ht:o:S:" )) != -1 ) {
+        switch ( c ) {
+        case 'h':
+            help() ;
+            break ;
+        case 't':
+            Workers = atoi(optarg);
+            break ;
+        case 'o':
+            Directory = optarg ;
+            break ;
+        case 'S':
+            Seed = strtoull(optarg, NULL, 0);
+            break ;
+        }
+    }
+    if ( optind >= argc ) {
+        fprintf( stderr, "No job file -- see distance_sweep -h\n" ) ;
+        return 1 ;
+    }
+    if ( Workers < 1 ) {
+        Workers = (int) sysconf( _SC_NPROCESSORS_ONLN ) ;
+        if ( Workers < 1 ) {
+            Workers = 1 ;
+        }
+    }
+    if ( Seed == 0 ) {
+        Seed = (unsigned long long) time( NULL ) ;
+    }
+
+    // Read all the jobs first -- a mistake on any line stops before any work
+    FILE * in = strcmp( argv[optind], "-" ) == 0 ? stdin : fopen( argv[optind], "r" ) ;
+    if ( in == NULL ) {
+        fprintf( stderr, "Cannot open job file %s\n", argv[optind] ) ;
+        return 1 ;
+    }
+    struct job * jobs = NULL ;
+    int Jobs = 0 ;
+    int errors = 0 ;
+    char * text = NULL ;
+    size_t alloc = 0 ;
+    for ( int line = 1 ; getline( &text, &alloc, in ) > 0 ; ++line ) {
+        char * comment = strchr( text, '#' ) ;
+        if ( comment ) {
+            *comment = '\0' ;
+        }
+        jobs = realloc( jobs, ( Jobs + 1 ) * sizeof( struct job ) ) ;
+        int parsed = job_parse( &jobs[Jobs], text, line, Directory ) ;
+        if ( parsed < 0 ) {
+            ++errors ;
+        } else if ( parsed > 0 ) {
+            jobs[Jobs].index = Jobs ;
+            ++Jobs ;
+        }
+    }
+    free( text ) ;
+    if ( in != stdin ) {
+        fclose( in ) ;
+    }
+    if ( errors || Jobs == 0 ) {
+        fprintf( stderr, errors ? "Nothing run -- fix the job file\n" : "No jobs in %s\n", argv[optind] ) ;
+        return 1 ;
+    }
+
+    // Cut the jobs into chunks of about equal work, dealt out in job order
+    struct sweep s ;
+    s.workers = Workers ;
+    s.seed = Seed ;
+    s.place = place_init( Workers ) ;
+    s.deques = aligned_alloc( 64, Workers * sizeof( struct deque ) ) ;
+    long tasks = 0 ;
+    for ( int j = 0 ; j < Jobs ; ++j ) {
+        struct job * job = &jobs[j] ;
+        long per = SWEEP_WORK / ( (long) job->dimensions * job->powerlist->size ) ;
+        long spread = ( job->samples + SWEEP_CHUNKS - 1 ) / SWEEP_CHUNKS ;
+        if ( per > spread ) {
+            per = spread ;
+        }
+        if ( per < 1 ) {
+            per = 1 ;
+        }
+        job->remaining = (int) ( ( job->samples + per - 1 ) / per ) ;
+        job->totals = calloc( job->cells, sizeof( double ) ) ;
+        pthread_mutex_init( &job->lock, NULL ) ;
+        tasks += job->remaining ;
+    }
+    for ( int w = 0 ; w < Workers ; ++w ) {
+        pthread_mutex_init( &s.deques[w].lock, NULL ) ;
+        s.deques[w].task = malloc( ( tasks / Workers + 1 ) * sizeof( struct task ) ) ;
+        s.deques[w].head = 0 ;
+        s.deques[w].tail = 0 ;
+    }
+    long dealt = 0 ;
+    for ( int j = 0 ; j < Jobs ; ++j ) {
+        struct job * job = &jobs[j] ;
+        long per = ( job->samples + job->remaining - 1 ) / job->remaining ;
+        for ( int chunk = 0 ; chunk < job->remaining ; ++chunk ) {
+            long first = chunk * per ;
+            struct deque * dq = &s.deques[dealt++ % Workers] ;
+            struct task task = { job, chunk, ( job->samples - first < per ) ? job->samples - first : per } ;
+            dq->task[dq->tail] = task ;
+            __atomic_store_n( &dq->tail, dq->tail + 1, __ATOMIC_RELAXED ) ;
+        }
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &s.start ) ;
+    struct worker w[Workers] ;
+    for ( int i = 0 ; i < Workers ; ++i ) {
+        w[i].id = i ;
+        w[i].sweep = &s ;
+        pthread_create( &w[i].thread, NULL, sweep_thread, &w[i] ) ;
+    }
+    for ( int i = 0 ; i < Workers ; ++i ) {
+        pthread_join( w[i].thread, NULL ) ;
+    }
+    double wall = seconds_since( &s.start ) ;
+
+    // against the ideal: all the work spread evenly over the threads
+    double work = 0. ;
+    for ( int j = 0 ; j < Jobs ; ++j ) {
+        work += jobs[j].work ;
+    }
+    fprintf( stderr, "%d jobs in %ld chunks on %d threads: %.2f s, work %.2f s, work/threads %.2f s (%.0f%% busy)\n",
+        Jobs, tasks, Workers, wall, work, work / Workers, 100. * work / Workers / wall ) ;
+
+    for ( int j = 0 ; j < Jobs ; ++j ) {
+        rangelist_free( jobs[j].powerlist ) ;
+        rangelist_free( jobs[j].dimlist ) ;
+        free( jobs[j].family ) ;
+        free( jobs[j].output ) ;
+        free( jobs[j].totals ) ;
+        pthread_mutex_destroy( &jobs[j].lock ) ;
+    }
+    free( jobs ) ;
+    for ( int i = 0 ; i < Workers ; ++i ) {
+        free( s.deques[i].task ) ;
+        pthread_mutex_destroy( &s.deques[i].lock ) ;
+    }
+    free( s.deques ) ;
+    place_free( s.place ) ;
+    return 0 ;
+}
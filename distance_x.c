@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <pthread.h>
+
+#include "refine.h"
+#include "moments.h"
+#include "place.h"
 
 void help( void )
 {
@@ -26,6 +32,11 @@ void help( void )
     printf("\t-p 3\tmax power (metric)\n");
     printf("\t-r 1000000\trandom points each measure\n");
     printf("\t-n\tnormalize (to longest diagonal)\n");
+    printf("\t-s\tstream -- running sums only, memory O(powers) rather than O(dimensions*powers)\n");
+    printf("\t-f 10\trefine forever -- print the table so far every 10 seconds\n");
+    printf("\t\tuntil interrupted (or -r samples if given). Sample count on stderr\n");
+    printf("\t-t 4\tthreads (default one per processor for -f, else 1) -- pinned, one per processor across the NUMA nodes\n");
+    printf("\t-M\tmoments -- variance, skew and excess kurtosis column groups after the means\n");
     printf("\t-h\tthis help\n");
     exit(0) ;
 }
@@ -33,8 +44,18 @@ void help( void )
 /* Includes for Mersenne Twister code
  * from http://www.math.sci.hiroshima-u.ac.jp/m-mat/MT/VERSIONS/C-LANG/mt19937-64.c
  * Some extra functions removed
+ * State is in a struct so each thread can have its own
  */
-double genrand64_real1(void) ;
+#define NN 312
+struct mt64 {
+    unsigned long long mt[NN] ; // state vector
+    int mti ; // mti==NN+1 means mt[NN] is not initialized
+} ;
+void init_genrand64( struct mt64 * state, unsigned long long seed ) ;
+double genrand64_real1( struct mt64 * state ) ;
+
+// samples published by each -f thread at a time
+#define REFINE_CHUNK 100
 
 // Separate mantissa and exponent
 // can be a little loose
@@ -89,64 +110,10 @@ void _ExpPrint( char * s, struct Exp * pexp ) {
     result = ldexp( pow( ldexp( (_exp).m, (_exp).e % (root) ), 1./(root) ) , mult ) ; \
     } while (0)
     
-int main( int argc, char **argv )
+// Sample random segments keeping a row of sums for every dimension
+void sample_prefix( int Dimensions, int Powers, long Randoms, struct mt64 * rng, double totals[Dimensions+1][Powers], struct moments * mom )
 {
-    int Dimensions = 100 ;
-    int Powers = 3 ;
-    long Randoms = 1000000 ;
-    int Normalize = 0;
-
-    // Arguments
-    int c;
-    while ( (c = getopt( argc, argv, "hd:p:r:n" )) != -1 ) {
-        switch ( c ) {
-        case 'h':
-            help() ;
-            break ;
-        case 'd':
-            Dimensions = atoi(optarg);
-            if (Dimensions<1) {
-                Dimensions = 1 ;
-            }
-            break ;
-        case 'p':
-            Powers = atoi(optarg);
-            if (Powers<3) {
-                Powers = 3 ;
-            }
-            break ;
-        case 'r':
-            Randoms = atoi(optarg);
-            if (Randoms<1000) {
-                Randoms = 1000 ;
-            }
-            break ;
-        case 'n':
-            Normalize = 1 ;
-            break ;
-        }
-    }
-
-    // Initialize totals to zero
-    double totals[Dimensions+1][Powers];
     int d,p;
-    for (d=0; d <= Dimensions; ++d) {
-        for (p=0; p<Powers; ++p) {
-            totals[d][p] = 0.;
-        }
-    }
-
-    // Title line
-    printf("DIM\\Power, ");
-    for (p=0;p<Powers;++p) {
-        printf("%d, ",p+1);
-    }
-    printf("\n");
-
-    // Basically the algorhythm is to compute a dx for each dimension
-    // then compute the series dx, dx^2, dx^3 ... (easy interative multiplication)
-    // compute sequentially dx^n for each dimension
-    // then take ^1/p  for each p and sum.
 
     struct Exp sums[Dimensions+1][Powers];
     for ( p=0; p<Powers ; ++p ) {
@@ -164,7 +131,7 @@ int main( int argc, char **argv )
             // we only care about dx, the delta in the coordinate
             // use absolute value for odd powers calculation
             double dx ;
-            dx = fabs( genrand64_real1() - genrand64_real1() );
+            dx = fabs( genrand64_real1( rng ) - genrand64_real1( rng ) );
 
             // for each power, the sum will be the entry from the row above
             // plus dx raised to that power.
@@ -184,9 +151,185 @@ int main( int argc, char **argv )
                 double length ; // segment length (in p-norm)
                 ExpRoot( sums[d][p], p+1, length ) ;
                 totals[d][p] += length;
+                if (mom) {
+                    moments_add( mom, d*Powers+p, length ) ;
+                }
+            }
+        }
+    }
+}
+
+// Sample random segments keeping only one running sum per power
+// memory is O(Powers) rather than O(Dimensions*Powers)
+void sample_stream( int Dimensions, int Powers, long Randoms, struct mt64 * rng, double totals[Dimensions+1][Powers], struct moments * mom )
+{
+    int d,p;
+    struct Exp running[Powers];
+
+    for (long r = 0; r < Randoms; ++r) {
+        // zero dimensional case
+        for ( p=0; p<Powers ; ++p ) {
+            ExpEncode( 0., running[p] ) ;
+        }
+
+        for (d=1; d <= Dimensions; ++d) {
+            double dx ;
+            dx = fabs( genrand64_real1( rng ) - genrand64_real1( rng ) );
+
+            struct Exp dx_raised ;
+            ExpEncode( 1., dx_raised ) ; // 0-th power
+
+            for (p=0; p<Powers; ++p) {
+                // dx^p added to the running sum in place
+                ExpMult( dx_raised, dx, dx_raised ) ;
+                ExpAdd( running[p], dx_raised, running[p] ) ;
+
+                double length ; // segment length (in p-norm)
+                ExpRoot( running[p], p+1, length ) ;
+                totals[d][p] += length;
+                if (mom) {
+                    moments_add( mom, d*Powers+p, length ) ;
+                }
             }
         }
     }
+}
+
+// One -f thread: sample forever, publishing to its slot a chunk at a time
+struct refiner {
+    pthread_t thread ;
+    int id ;
+    int Dimensions ;
+    int Powers ;
+    struct refine * rf ;
+    struct place * place ;
+    int * stop ;
+    // -M: moments so far, merged in a chunk at a time under lock
+    struct moments * mom ;
+    pthread_mutex_t lock ;
+} ;
+
+void * refine_thread( void * arg )
+{
+    struct refiner * r = arg ;
+    place_pin( r->place, r->id ) ;
+    struct mt64 rng ;
+    init_genrand64( &rng, (unsigned long long) time(NULL) * 2654435761ULL + r->id ) ;
+
+    double * totals = place_zeros( r->place, r->rf->cells ) ;
+    struct moments * chunk = r->mom ? moments_init( r->mom->cells ) : NULL ;
+    while ( ! __atomic_load_n( r->stop, __ATOMIC_RELAXED ) ) {
+        memset( totals, 0, r->rf->cells * sizeof( double ) ) ;
+        sample_stream( r->Dimensions, r->Powers, REFINE_CHUNK, &rng, (double (*)[r->Powers]) totals, chunk ) ;
+        if ( chunk ) {
+            pthread_mutex_lock( &r->lock ) ;
+            moments_merge( r->mom, chunk ) ;
+            pthread_mutex_unlock( &r->lock ) ;
+            moments_clear( chunk ) ;
+        }
+        refine_publish( r->rf, r->id, totals, REFINE_CHUNK ) ;
+    }
+    if ( chunk ) {
+        moments_free( chunk ) ;
+    }
+    place_release( r->place, totals, r->rf->cells ) ;
+    return NULL ;
+}
+
+// One thread of a fixed run: its share of the samples into its own totals
+struct worker {
+    pthread_t thread ;
+    int id ;
+    int Dimensions ;
+    int Powers ;
+    long Randoms ;
+    int Stream ;
+    struct place * place ;
+    pthread_barrier_t * barrier ;
+    double ** totals ; // every worker's, for the per-node reduction
+    struct moments * mom ;
+} ;
+
+void * worker_thread( void * arg )
+{
+    struct worker * w = arg ;
+    place_pin( w->place, w->id ) ;
+    struct mt64 rng ;
+    // worker 0 is seeded as the single-threaded run always was
+    init_genrand64( &rng, (unsigned long long) time(NULL) + w->id * 2654435761ULL ) ;
+
+    size_t cells = (size_t) ( w->Dimensions+1 ) * w->Powers ;
+    double * totals = place_zeros( w->place, cells ) ;
+    w->totals[w->id] = totals ;
+    if (w->Stream) {
+        sample_stream( w->Dimensions, w->Powers, w->Randoms, &rng, (double (*)[w->Powers]) totals, w->mom ) ;
+    } else {
+        sample_prefix( w->Dimensions, w->Powers, w->Randoms, &rng, (double (*)[w->Powers]) totals, w->mom ) ;
+    }
+
+    // node totals first, while the arrays are still local to it
+    pthread_barrier_wait( w->barrier ) ;
+    place_reduce( w->place, w->id, w->totals, cells ) ;
+    return NULL ;
+}
+
+// Randoms samples split over Threads workers
+void sample_threads( int Dimensions, int Powers, long Randoms, int Stream, int Threads, double totals[Dimensions+1][Powers], struct moments * mom )
+{
+    size_t cells = (size_t) ( Dimensions+1 ) * Powers ;
+    struct place * pl = place_init( Threads ) ;
+    pthread_barrier_t barrier ;
+    pthread_barrier_init( &barrier, NULL, Threads ) ;
+    double * arrays[Threads] ;
+    struct worker w[Threads] ;
+    for (int t=0; t<Threads; ++t) {
+        w[t].id = t ;
+        w[t].Dimensions = Dimensions ;
+        w[t].Powers = Powers ;
+        w[t].Randoms = Randoms / Threads + ( t < Randoms % Threads ) ;
+        w[t].Stream = Stream ;
+        w[t].place = pl ;
+        w[t].barrier = &barrier ;
+        w[t].totals = arrays ;
+        w[t].mom = mom ? moments_init( mom->cells ) : NULL ;
+        pthread_create( &w[t].thread, NULL, worker_thread, &w[t] ) ;
+    }
+    for (int t=0; t<Threads; ++t) {
+        pthread_join( w[t].thread, NULL ) ;
+        if ( mom ) {
+            moments_merge( mom, w[t].mom ) ;
+            moments_free( w[t].mom ) ;
+        }
+    }
+    place_total( pl, arrays, cells, &totals[0][0] ) ;
+    for (int t=0; t<Threads; ++t) {
+        place_release( pl, arrays[t], cells ) ;
+    }
+    pthread_barrier_destroy( &barrier ) ;
+    place_free( pl ) ;
+}
+
+void print_table( int Dimensions, int Powers, long Randoms, int Normalize, double totals[Dimensions+1][Powers], struct moments * mom )
+{
+    int d,p;
+
+    // Title line
+    printf("DIM\\Power, ");
+    for (p=0;p<Powers;++p) {
+        printf("%d, ",p+1);
+    }
+    if (mom) {
+        for (p=0;p<Powers;++p) {
+            printf("var %d, ",p+1);
+        }
+        for (p=0;p<Powers;++p) {
+            printf("skew %d, ",p+1);
+        }
+        for (p=0;p<Powers;++p) {
+            printf("kurt %d, ",p+1);
+        }
+    }
+    printf("\n");
 
     // Loop though solutions for averaging (norming) and display
     for (d=1; d <= Dimensions; ++d) {
@@ -196,18 +339,199 @@ int main( int argc, char **argv )
         // Print out the distances
         for (p=0;p<Powers;++p) {
             if (Normalize) {
-                for (p=0;p<Powers;++p){
-                    // note p is 0-indexed in C, but 1-indexed for calculation
-                    printf("%g, ", totals[d][p]/Randoms/pow(d,1./(1+p)));
-                }
+                // note p is 0-indexed in C, but 1-indexed for calculation
+                printf("%g, ", totals[d][p]/Randoms/pow(d,1./(1+p)));
             } else {
-                for (p=0;p<Powers;++p){
-                    printf("%g, ", totals[d][p]/Randoms);
+                printf("%g, ", totals[d][p]/Randoms);
+            }
+        }
+
+        // moment column groups (variance scales with the square of the length)
+        if (mom) {
+            for (p=0;p<Powers;++p) {
+                double scale = Normalize ? pow(d,1./(1+p)) : 1. ;
+                printf("%g, ", moments_variance( mom, d*Powers+p )/(scale*scale));
+            }
+            for (p=0;p<Powers;++p) {
+                printf("%g, ", moments_skew( mom, d*Powers+p ));
+            }
+            for (p=0;p<Powers;++p) {
+                printf("%g, ", moments_kurtosis( mom, d*Powers+p ));
+            }
+        }
+        // finish line
+        printf("\n");
+    }
+}
+
+// Refine forever with Threads workers, printing a snapshot every Interval seconds
+// stops once there are Randoms samples (if Randoms > 0)
+void refine( int Dimensions, int Powers, long Randoms, int Normalize, int Threads, double Interval, int Moments )
+{
+    struct refine * rf = refine_init( Threads, (size_t) ( Dimensions+1 ) * Powers ) ;
+    struct place * pl = place_init( Threads ) ;
+    struct refiner r[Threads] ;
+    int stop = 0 ;
+    for (int t=0; t<Threads; ++t) {
+        r[t].id = t ;
+        r[t].Dimensions = Dimensions ;
+        r[t].Powers = Powers ;
+        r[t].rf = rf ;
+        r[t].place = pl ;
+        r[t].stop = &stop ;
+        r[t].mom = Moments ? moments_init( rf->cells ) : NULL ;
+        pthread_mutex_init( &r[t].lock, NULL ) ;
+        pthread_create( &r[t].thread, NULL, refine_thread, &r[t] ) ;
+    }
+    // all the threads' moments merged for each snapshot
+    struct moments * mom = Moments ? moments_init( rf->cells ) : NULL ;
+
+    double (*totals)[Powers] = malloc( rf->cells * sizeof( double ) ) ;
+    double tick = Interval < 0.01 ? Interval : 0.01 ; // check for the end this often
+    struct timespec poll = { 0, (long) ( tick * 1e9 ) } ;
+    double waited = 0. ;
+    while ( 1 ) {
+        nanosleep( &poll, NULL ) ;
+        waited += tick ;
+        int finished = ( Randoms > 0 && refine_samples( rf ) >= Randoms ) ;
+        if ( finished ) {
+            __atomic_store_n( &stop, 1, __ATOMIC_RELAXED ) ;
+            for (int t=0; t<Threads; ++t) {
+                pthread_join( r[t].thread, NULL ) ;
+            }
+        }
+        if ( finished || waited >= Interval ) {
+            long samples = refine_snapshot( rf, &totals[0][0] ) ;
+            if ( mom ) {
+                moments_clear( mom ) ;
+                for (int t=0; t<Threads; ++t) {
+                    pthread_mutex_lock( &r[t].lock ) ;
+                    moments_merge( mom, r[t].mom ) ;
+                    pthread_mutex_unlock( &r[t].lock ) ;
                 }
             }
-            // finish line
-            printf("\n");
+            if ( samples > 0 ) {
+                print_table( Dimensions, Powers, samples, Normalize, totals, mom ) ;
+                printf("\n");
+                fflush( stdout ) ;
+                fprintf( stderr, "samples %ld\n", samples ) ;
+            }
+            waited = 0. ;
         }
+        if ( finished ) {
+            break ;
+        }
+    }
+    free( totals ) ;
+    if ( mom ) {
+        moments_free( mom ) ;
+        for (int t=0; t<Threads; ++t) {
+            moments_free( r[t].mom ) ;
+        }
+    }
+    for (int t=0; t<Threads; ++t) {
+        pthread_mutex_destroy( &r[t].lock ) ;
+    }
+    refine_free( rf ) ;
+    place_free( pl ) ;
+}
+
+int main( int argc, char **argv )
+{
+    int Dimensions = 100 ;
+    int Powers = 3 ;
+    long Randoms = 1000000 ;
+    int Normalize = 0;
+    int Stream = 0; // running sums only (no Dimensions x Powers sums table)
+    double Interval = 0.; // -f refine forever, snapshot every Interval seconds
+    int Threads = sysconf( _SC_NPROCESSORS_ONLN ) ;
+    int RandomsGiven = 0;
+    int ThreadsGiven = 0;
+    int Moments = 0; // -M variance, skew, kurtosis too
+
+    // Arguments
+    int c;
+    while ( (c = getopt( argc, argv, "hd:p:r:nsf:t:M" )) != -1 ) {
+        switch ( c ) {
+        case 'h':
+            help() ;
+            break ;
+        case 'd':
+            Dimensions = atoi(optarg);
+            if (Dimensions<1) {
+                Dimensions = 1 ;
+            }
+            break ;
+        case 'p':
+            Powers = atoi(optarg);
+            if (Powers<3) {
+                Powers = 3 ;
+            }
+            break ;
+        case 'r':
+            Randoms = atoi(optarg);
+            if (Randoms<1000) {
+                Randoms = 1000 ;
+            }
+            RandomsGiven = 1 ;
+            break ;
+        case 'n':
+            Normalize = 1 ;
+            break ;
+        case 's':
+            Stream = 1 ;
+            break ;
+        case 'f':
+            Interval = atof(optarg);
+            if (Interval<=0.) {
+                Interval = 10. ;
+            }
+            break ;
+        case 't':
+            Threads = atoi(optarg);
+            if (Threads<1) {
+                Threads = 1 ;
+            }
+            ThreadsGiven = 1 ;
+            break ;
+        case 'M':
+            Moments = 1 ;
+            break ;
+        }
+    }
+
+    if (Interval > 0.) {
+        refine( Dimensions, Powers, RandomsGiven ? Randoms : 0, Normalize, Threads, Interval, Moments ) ;
+        return 0 ;
+    }
+
+    // Initialize totals to zero
+    double totals[Dimensions+1][Powers];
+    int d,p;
+    for (d=0; d <= Dimensions; ++d) {
+        for (p=0; p<Powers; ++p) {
+            totals[d][p] = 0.;
+        }
+    }
+
+    // Basically the algorhythm is to compute a dx for each dimension
+    // then compute the series dx, dx^2, dx^3 ... (easy interative multiplication)
+    // compute sequentially dx^n for each dimension
+    // then take ^1/p  for each p and sum.
+
+    struct moments * mom = Moments ? moments_init( (Dimensions+1)*Powers ) : NULL ;
+    // a fixed run is one thread unless asked (the same seed gives the same table)
+    if ( ! ThreadsGiven ) {
+        Threads = 1 ;
+    }
+    if ( Threads > Randoms ) {
+        Threads = (int) Randoms ;
+    }
+    sample_threads( Dimensions, Powers, Randoms, Stream, Threads, totals, mom ) ;
+
+    print_table( Dimensions, Powers, Randoms, Normalize, totals, mom ) ;
+    if (mom) {
+        moments_free( mom ) ;
     }
 
     // success
@@ -269,39 +593,39 @@ int main( int argc, char **argv )
    email: m-mat @ math.sci.hiroshima-u.ac.jp (remove spaces)
 */
 
-#define NN 312
 #define MM 156
 #define MATRIX_A 0xB5026F5AA96619E9ULL
 #define UM 0xFFFFFFFF80000000ULL /* Most significant 33 bits */
 #define LM 0x7FFFFFFFULL /* Least significant 31 bits */
 
 
-/* The array for the state vector */
-static unsigned long long mt[NN]; 
-/* mti==NN+1 means mt[NN] is not initialized */
-static int mti=NN+1; 
+/* The array for the state vector (and mti) are in struct mt64 */
 
 /* initializes mt[NN] with a seed */
-void init_genrand64(void)
+void init_genrand64( struct mt64 * state, unsigned long long seed )
 {
-    mt[0] = 0xA542B234C76 | (unsigned long long) time(NULL); // Use time() for seed -- not great but this isn't crypto
+    unsigned long long * mt = state->mt ;
+    int mti ;
+    mt[0] = 0xA542B234C76 ^ seed; // Use time() for seed -- not great but this isn't crypto
     for (mti=1; mti<NN; mti++) 
         mt[mti] =  (6364136223846793005ULL * (mt[mti-1] ^ (mt[mti-1] >> 62)) + mti);
+    state->mti = mti ;
 }
 
 /* generates a random number on [0, 2^64-1]-interval */
-unsigned long long genrand64_int64(void)
+unsigned long long genrand64_int64( struct mt64 * state )
 {
     int i;
     unsigned long long x;
-    static unsigned long long mag01[2]={0ULL, MATRIX_A};
+    static const unsigned long long mag01[2]={0ULL, MATRIX_A};
+    unsigned long long * mt = state->mt ;
 
-    if (mti >= NN) { /* generate NN words at one time */
+    if (state->mti >= NN) { /* generate NN words at one time */
 
         /* if init_genrand64() has not been called, */
         /* a default initial seed is used     */
-        if (mti == NN+1) 
-            init_genrand64(); 
+        if (state->mti == NN+1) 
+            init_genrand64( state, (unsigned long long) time(NULL) ); 
 
         for (i=0;i<NN-MM;i++) {
             x = (mt[i]&UM)|(mt[i+1]&LM);
@@ -314,10 +638,10 @@ unsigned long long genrand64_int64(void)
         x = (mt[NN-1]&UM)|(mt[0]&LM);
         mt[NN-1] = mt[MM-1] ^ (x>>1) ^ mag01[(int)(x&1ULL)];
 
-        mti = 0;
+        state->mti = 0;
     }
   
-    x = mt[mti++];
+    x = mt[state->mti++];
 
     x ^= (x >> 29) & 0x5555555555555555ULL;
     x ^= (x << 17) & 0x71D67FFFEDA60000ULL;
@@ -328,7 +652,7 @@ unsigned long long genrand64_int64(void)
 }
 
 /* generates a random number on [0,1]-real-interval */
-double genrand64_real1(void)
+double genrand64_real1( struct mt64 * state )
 {
-    return (genrand64_int64() >> 11) * (1.0/9007199254740991.0);
+    return (genrand64_int64( state ) >> 11) * (1.0/9007199254740991.0);
 }
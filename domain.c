@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <ctype.h>
+
+#include "domain.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+static const char * domain_names[] = { "cube", "torus", "gaussian", "ball", "sphere", "simplex" } ;
+
+int domain_parse( const char * name )
+{
+    for ( int i = 0 ; i < (int) ( sizeof( domain_names ) / sizeof( domain_names[0] ) ) ; ++i ) {
+        if ( strcmp( name, domain_names[i] ) == 0 ) {
+            return i ;
+        }
+    }
+    return -1 ;
+}
+
+const char * domain_name( enum domain Domain )
+{
+    return domain_names[Domain] ;
+}
+
+double domain_diagonal( enum domain Domain, int d, double power )
+{
+    switch ( Domain ) {
+    case DOMAIN_TORUS:
+        // farthest apart is half way round in every dimension
+        return .5 * pow( d, 1./power ) ;
+    case DOMAIN_BALL:
+    case DOMAIN_SPHERE:
+        // opposite ends of a diameter -- along an axis for p>=2, along (1,1,..)/sqrt(d) below
+        return ( power >= 2. ) ? 2. : 2. * pow( d, 1./power - .5 ) ;
+    case DOMAIN_SIMPLEX:
+        // between two corners (other than the origin)
+        return ( d < 2 ) ? 1. : pow( 2., 1./power ) ;
+    default:
+        return pow( d, 1./power ) ;
+    }
+}
+
+double * domain_extents( const char * path, int Dimensions )
+{
+    FILE * f = fopen( path, "r" ) ;
+    if ( f == NULL ) {
+        fprintf( stderr, "Cannot open extents file %s\n", path ) ;
+        return NULL ;
+    }
+    double * extent = malloc( Dimensions * sizeof( double ) ) ;
+    int n = 0 ;
+    int c ;
+    while ( n < Dimensions && ( c = getc( f ) ) != EOF ) {
+        if ( c == '#' ) {
+            while ( c != '\n' && c != EOF ) {
+                c = getc( f ) ;
+            }
+            continue ;
+        }
+        if ( isspace( c ) || c == ',' || c == ';' ) {
+            continue ;
+        }
+        ungetc( c, f ) ;
+        double v ;
+        if ( fscanf( f, "%lf", &v ) != 1 || ! ( v > 0. ) ) {
+            fprintf( stderr, "Extent for axis %d in %s is not a positive number\n", n+1, path ) ;
+            fclose( f ) ;
+            free( extent ) ;
+            return NULL ;
+        }
+        extent[n++] = v ;
+    }
+    fclose( f ) ;
+    if ( n < Dimensions ) {
+        fprintf( stderr, "Only %d extents in %s for %d dimensions\n", n, path, Dimensions ) ;
+        free( extent ) ;
+        return NULL ;
+    }
+    return extent ;
+}
+
+// log of domain_diagonal without taking the root
+static double domain_log_diagonal( enum domain Domain, int d, double power )
+{
+    switch ( Domain ) {
+    case DOMAIN_TORUS:
+        return log( .5 ) + log( d ) / power ;
+    case DOMAIN_BALL:
+    case DOMAIN_SPHERE:
+        return ( power >= 2. ) ? log( 2. ) : log( 2. ) + ( 1./power - .5 ) * log( d ) ;
+    case DOMAIN_SIMPLEX:
+        return ( d < 2 ) ? 0. : log( 2. ) / power ;
+    default:
+        return log( d ) / power ;
+    }
+}
+
+void domain_diagonals( enum domain Domain, int Dimensions, int powers, const double * values, const double * extent, double * diagonal, double * log_diagonal )
+{
+    double sum[powers] ;
+    for ( int ip = 0 ; ip < powers ; ++ip ) {
+        diagonal[ip] = 0. ;
+        if ( log_diagonal ) {
+            log_diagonal[ip] = -HUGE_VAL ;
+        }
+        sum[ip] = 0. ;
+    }
+    for ( int d = 1 ; d <= Dimensions ; ++d ) {
+        for ( int ip = 0 ; ip < powers ; ++ip ) {
+            double half = ( Domain == DOMAIN_TORUS ) ? .5 : 1. ;
+            if ( extent == NULL || ! domain_separable( Domain ) ) {
+                diagonal[d*powers+ip] = domain_diagonal( Domain, d, values[ip] ) ;
+                if ( log_diagonal ) {
+                    log_diagonal[d*powers+ip] = isinf( values[ip] ) ? log( diagonal[d*powers+ip] ) : domain_log_diagonal( Domain, d, values[ip] ) ;
+                }
+            } else if ( isinf( values[ip] ) ) {
+                // the longest side (half way round for the torus)
+                sum[ip] = fmax( sum[ip], extent[d-1] ) ;
+                diagonal[d*powers+ip] = sum[ip] * half ;
+                if ( log_diagonal ) {
+                    log_diagonal[d*powers+ip] = log( diagonal[d*powers+ip] ) ;
+                }
+            } else {
+                // the box's own diagonal (half way round for the torus)
+                sum[ip] += pow( extent[d-1], values[ip] ) ;
+                diagonal[d*powers+ip] = pow( sum[ip], 1./values[ip] ) * half ;
+                if ( log_diagonal ) {
+                    log_diagonal[d*powers+ip] = log( sum[ip] ) / values[ip] + log( half ) ;
+                }
+            }
+        }
+    }
+}
+
+// uniform in (0,1] -- safe for log
+#define UNIFORM_OPEN() ( ( rand() + 1. ) * ( 1. / ( RAND_MAX + 1. ) ) )
+
+double domain_gaussian( void )
+{
+    static int have_spare = 0 ;
+    static double spare ;
+    if ( have_spare ) {
+        have_spare = 0 ;
+        return spare ;
+    }
+    double radius = sqrt( -2. * log( UNIFORM_OPEN() ) ) ;
+    double angle = 2. * M_PI * rand() * ( 1. / ( RAND_MAX + 1. ) ) ;
+    spare = radius * sin( angle ) ;
+    have_spare = 1 ;
+    return radius * cos( angle ) ;
+}
+
+void domain_gaussians( int n, double g[n] )
+{
+    // Box-Muller in pairs: draw all the uniforms, then transform them together
+    int pairs = ( n + 1 ) / 2 ;
+    double radius[pairs] ;
+    double angle[pairs] ;
+    for ( int k = 0 ; k < pairs ; ++k ) {
+        radius[k] = UNIFORM_OPEN() ;
+        angle[k] = rand() * ( 1. / ( RAND_MAX + 1. ) ) ;
+    }
+    for ( int k = 0 ; k < pairs ; ++k ) {
+        radius[k] = sqrt( -2. * log( radius[k] ) ) ;
+        angle[k] *= 2. * M_PI ;
+    }
+    for ( int k = 0 ; k < n / 2 ; ++k ) {
+        g[2*k] = radius[k] * cos( angle[k] ) ;
+        g[2*k+1] = radius[k] * sin( angle[k] ) ;
+    }
+    if ( n % 2 ) {
+        g[n-1] = radius[pairs-1] * cos( angle[pairs-1] ) ;
+    }
+}
+
+void domain_exponentials( int n, double e[n] )
+{
+    for ( int i = 0 ; i < n ; ++i ) {
+        e[i] = UNIFORM_OPEN() ;
+    }
+    for ( int i = 0 ; i < n ; ++i ) {
+        e[i] = -log( e[i] ) ;
+    }
+}
+
+void domain_fill( enum domain Domain, int n, double dx[n] )
+{
+    switch ( Domain ) {
+    case DOMAIN_GAUSSIAN:
+        // difference of two standard normals is normal with variance 2
+        domain_gaussians( n, dx ) ;
+        for ( int i = 0 ; i < n ; ++i ) {
+            dx[i] = M_SQRT2 * fabs( dx[i] ) ;
+        }
+        break ;
+    case DOMAIN_TORUS:
+        for ( int i = 0 ; i < n ; ++i ) {
+            dx[i] = fabs((rand() - rand()) * (1.0 / RAND_MAX));
+        }
+        for ( int i = 0 ; i < n ; ++i ) {
+            dx[i] = ( dx[i] > .5 ) ? 1. - dx[i] : dx[i] ;
+        }
+        break ;
+    default:
+        for ( int i = 0 ; i < n ; ++i ) {
+            dx[i] = fabs((rand() - rand()) * (1.0 / RAND_MAX));
+        }
+        break ;
+    }
+}
+
+void domain_coords( enum domain Domain, int n, double x[n], double y[n], double dx[n] )
+{
+    if ( Domain == DOMAIN_GAUSSIAN ) {
+        domain_gaussians( n, x ) ;
+        domain_gaussians( n, y ) ;
+    } else {
+        for ( int i = 0 ; i < n ; ++i ) {
+            x[i] = rand() * (1.0 / RAND_MAX) ;
+            y[i] = rand() * (1.0 / RAND_MAX) ;
+        }
+    }
+    for ( int i = 0 ; i < n ; ++i ) {
+        dx[i] = fabs( x[i] - y[i] ) ;
+    }
+    if ( Domain == DOMAIN_TORUS ) {
+        for ( int i = 0 ; i < n ; ++i ) {
+            dx[i] = ( dx[i] > .5 ) ? 1. - dx[i] : dx[i] ;
+        }
+    }
+}
+
+// raw coordinates and per-dimension scales of one point
+static void domain_point( enum domain Domain, int Dimensions, double x[Dimensions], double scale[Dimensions+1] )
+{
+    double sum = 0. ;
+    scale[0] = 0. ;
+    switch ( Domain ) {
+    case DOMAIN_BALL:
+    case DOMAIN_SPHERE:
+        {
+            // direction from the normal vector, norm by prefix sums of squares
+            domain_gaussians( Dimensions, x ) ;
+            // one radius draw for all dimensions (each dimension is still uniform)
+            double u = UNIFORM_OPEN() ;
+            for ( int d = 1 ; d <= Dimensions ; ++d ) {
+                sum += x[d-1] * x[d-1] ;
+                scale[d] = 1. / sqrt( sum ) ;
+                if ( Domain == DOMAIN_BALL ) {
+                    scale[d] *= pow( u, 1./d ) ;
+                }
+            }
+        }
+        break ;
+    case DOMAIN_SIMPLEX:
+        // d+1 exponentials over their sum (Dirichlet(1,..,1)) less the extra one
+        domain_exponentials( 1, &sum ) ;
+        domain_exponentials( Dimensions, x ) ;
+        for ( int d = 1 ; d <= Dimensions ; ++d ) {
+            sum += x[d-1] ;
+            scale[d] = 1. / sum ;
+        }
+        break ;
+    default:
+        fprintf( stderr, "Domain %s has independent coordinates\n", domain_name( Domain ) ) ;
+        exit( 1 ) ;
+    }
+}
+
+void domain_points( enum domain Domain, int Dimensions, double x[Dimensions], double y[Dimensions], double xscale[Dimensions+1], double yscale[Dimensions+1] )
+{
+    domain_point( Domain, Dimensions, x, xscale ) ;
+    domain_point( Domain, Dimensions, y, yscale ) ;
+}
@@ -0,0 +1,86 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// --domain: where the two random points come from
+//
+// Separable domains have independent coordinate differences, so the
+// per-dimension dx feeds the usual prefix / stream / batch sums:
+//   cube      uniform in the unit N-cube (the original)
+//   torus     unit N-cube with wraparound, dx = min(dx,1-dx)
+//   gaussian  independent standard normal coordinates
+// The others couple all the coordinates of a point, so every dimension
+// needs its own points. domain_points makes raw coordinates once per sample
+// plus a scale for each dimension d from prefix sums, and the point in
+// d dimensions is the first d coordinates times scale[d]:
+//   ball      uniform in the unit (L2) N-ball -- normal vector / its norm * U^(1/d)
+//   sphere    uniform on the unit (L2) N-sphere -- normal vector / its norm
+//   simplex   uniform in the corner simplex x>=0, sum(x)<=1 -- exponentials / their sum (with one extra)
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+enum domain { DOMAIN_CUBE, DOMAIN_TORUS, DOMAIN_GAUSSIAN, DOMAIN_BALL, DOMAIN_SPHERE, DOMAIN_SIMPLEX } ;
+
+// name -> domain (-1 if unknown)
+int domain_parse( const char * name ) ;
+const char * domain_name( enum domain Domain ) ;
+
+static inline int domain_separable( enum domain Domain )
+{
+    return Domain == DOMAIN_CUBE || Domain == DOMAIN_TORUS || Domain == DOMAIN_GAUSSIAN ;
+}
+
+// Longest segment (Lp) in d dimensions -- what -n normalizes to
+// (gaussian has none, it uses the cube's diagonal)
+double domain_diagonal( enum domain Domain, int d, double power ) ;
+
+// -w: per-axis extents (side lengths, or weights -- the same thing for Lp lengths)
+// from a file of numbers separated by spaces, commas or newlines (# starts a comment)
+// NULL (with a message) if unreadable, not positive, or fewer than Dimensions
+double * domain_extents( const char * path, int Dimensions ) ;
+
+// diagonal[d*powers+ip] for every dimension d (0 to Dimensions) and power, the longest segment with
+// these extents (separable domains only, NULL for unit extents):
+// (sum of extent^p over the first d axes)^(1/p) by prefix sums (max extent for p=inf)
+// log_diagonal (if not NULL, same layout) gets its log, found without the root -- it stays finite for tiny p
+void domain_diagonals( enum domain Domain, int Dimensions, int powers, const double * values, const double * extent, double * diagonal, double * log_diagonal ) ;
+
+// a standard normal (Box-Muller, the second of each pair kept for the next call)
+double domain_gaussian( void ) ;
+
+// |x1-x2| for one coordinate of a separable domain
+static inline double domain_dx( enum domain Domain )
+{
+    double dx ;
+    switch ( Domain ) {
+    case DOMAIN_TORUS:
+        dx = fabs((rand() - rand()) * (1.0 / RAND_MAX));
+        return ( dx > .5 ) ? 1. - dx : dx ;
+    case DOMAIN_GAUSSIAN:
+        return M_SQRT2 * fabs( domain_gaussian() ) ;
+    default:
+        return fabs((rand() - rand()) * (1.0 / RAND_MAX));
+    }
+}
+
+// n coordinate differences at once (the math vectorizes, rand() doesn't)
+void domain_fill( enum domain Domain, int n, double dx[n] ) ;
+
+// n coordinates of both points of a separable domain, and their differences dx
+// (for distances that need the points themselves, not just dx)
+void domain_coords( enum domain Domain, int n, double x[n], double y[n], double dx[n] ) ;
+
+// n standard normals and n unit exponentials
+void domain_gaussians( int n, double g[n] ) ;
+void domain_exponentials( int n, double e[n] ) ;
+
+// Two points of a non-separable domain (see above)
+// x and y have Dimensions raw coordinates, xscale and yscale Dimensions+1 scales
+void domain_points( enum domain Domain, int Dimensions, double x[Dimensions], double y[Dimensions], double xscale[Dimensions+1], double yscale[Dimensions+1] ) ;
+
+#endif /* DOMAIN_H */
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "exact.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Rather than integrating over the 2N coordinates directly, use
+// the coordinate differences X = dx^p which are independent with
+// dx having density 2(1-x) on [0,1]. The segment length is S^(1/p)
+// with S the sum of the X's. Writing 1/p = n + b (n integer, 0<=b<1)
+//
+//   S^b = b/Gamma(1-b) * Integral[0,inf] (1 - exp(-tS)) t^(-b-1) dt
+//
+// so E[S^n S^b] needs only the Laplace transform of one dimension:
+//   E[X^j exp(-tX)] = 2a [ t^-(a+j) gamma(a+j,t) - t^-(2a+j) gamma(2a+j,t) ]  (a=1/p)
+// which turns the N-dimensional integral into a 1-dimensional one.
+
+// E[dx^(pj)]
+static double moment( double p, int j )
+{
+    return 2. / ( (j*p+1.) * (j*p+2.) ) ;
+}
+
+// t^-s * (lower incomplete gamma)(s,t)
+// series for small t, continued fraction (Lentz) for large t
+static double gamma_scaled( double s, double t )
+{
+    if ( t < s + 1. ) {
+        double term = 1. / s ;
+        double sum = term ;
+        for ( int k = 1 ; k < 1000 ; ++k ) {
+            term *= t / (s+k) ;
+            sum += term ;
+            if ( term < sum * 1e-17 ) {
+                break ;
+            }
+        }
+        return exp( -t ) * sum ;
+    } else {
+        double tiny = 1e-300 ;
+        double b = t + 1. - s ;
+        double c = 1. / tiny ;
+        double d = 1. / b ;
+        double h = d ;
+        for ( int i = 1 ; i < 1000 ; ++i ) {
+            double an = -i * ( i - s ) ;
+            b += 2. ;
+            d = an * d + b ;
+            if ( fabs(d) < tiny ) {
+                d = tiny ;
+            }
+            c = b + an / c ;
+            if ( fabs(c) < tiny ) {
+                c = tiny ;
+            }
+            d = 1. / d ;
+            double del = d * c ;
+            h *= del ;
+            if ( fabs( del - 1. ) < 1e-17 ) {
+                break ;
+            }
+        }
+        // Gamma(s) t^-s - upper incomplete gamma scaled
+        return exp( lgamma( s ) - s * log( t ) ) - exp( -t ) * h ;
+    }
+}
+
+// One dimension: e[j] = E[X^j exp(-tX)] for j = 0..m (t=0 gives the moments)
+static void one_dim( double p, double t, int m, double * e )
+{
+    double a = 1. / p ;
+    for ( int j = 0 ; j <= m ; ++j ) {
+        if ( t == 0. ) {
+            e[j] = moment( p, j ) ;
+        } else {
+            e[j] = 2. * a * ( gamma_scaled( a+j, t ) - gamma_scaled( 2*a+j, t ) ) ;
+        }
+    }
+}
+
+// Add dimensions one at a time:
+//   E[S^k exp(-tS)] for S = sum over all dimensions, k = 0..m
+// exp(-tS) factors across dimensions so a binomial expansion works
+// (all terms positive -- no cancellation)
+static void all_dim( int dimension, const double * e, int m, double * h )
+{
+    double prior[m+1] ;
+    h[0] = 1. ;
+    for ( int k = 1 ; k <= m ; ++k ) {
+        h[k] = 0. ;
+    }
+    for ( int d = 0 ; d < dimension ; ++d ) {
+        for ( int k = 0 ; k <= m ; ++k ) {
+            prior[k] = h[k] ;
+        }
+        for ( int k = 0 ; k <= m ; ++k ) {
+            double binomial = 1. ;
+            double sum = 0. ;
+            for ( int i = 0 ; i <= k ; ++i ) {
+                sum += binomial * prior[k-i] * e[i] ;
+                binomial = binomial * (k-i) / (i+1) ;
+            }
+            h[k] = sum ;
+        }
+    }
+}
+
+// E[S^n exp(-tS)]
+static double transform( int dimension, double p, int n, double t )
+{
+    double e[n+1] ;
+    double h[n+1] ;
+    one_dim( p, t, n, e ) ;
+    all_dim( dimension, e, n, h ) ;
+    return h[n] ;
+}
+
+// Integrand in u = ln(t) : (E[S^n] - E[S^n exp(-tS)]) t^-b
+struct integrand {
+    int dimension ;
+    double p ;
+    int n ;
+    double b ;
+    double moment_n ; // E[S^n]
+} ;
+
+static double integrand_eval( const struct integrand * f, double u )
+{
+    double t = exp( u ) ;
+    return ( f->moment_n - transform( f->dimension, f->p, f->n, t ) ) * exp( -f->b * u ) ;
+}
+
+// Gauss-Kronrod 7-15 nodes and weights (symmetric half)
+static const double xgk[8] = {
+    0.991455371120812639206854697526329,
+    0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926,
+    0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013,
+    0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245,
+    0.000000000000000000000000000000000
+} ;
+static const double wgk[8] = {
+    0.022935322010529224963732008058970,
+    0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518,
+    0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550,
+    0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649,
+    0.209482141084727828012999174891714
+} ;
+static const double wg[4] = {
+    0.129484966168869693270611432679082,
+    0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975,
+    0.417959183673469387755102040816327
+} ;
+
+// Kronrod estimate on [lo,hi], error from the embedded Gauss rule
+static double gk15( const struct integrand * f, double lo, double hi, double * err )
+{
+    double center = 0.5 * ( lo + hi ) ;
+    double half = 0.5 * ( hi - lo ) ;
+    double fc = integrand_eval( f, center ) ;
+    double kronrod = fc * wgk[7] ;
+    double gauss = fc * wg[3] ;
+    for ( int j = 0 ; j < 7 ; ++j ) {
+        double dx = half * xgk[j] ;
+        double fsum = integrand_eval( f, center - dx ) + integrand_eval( f, center + dx ) ;
+        kronrod += wgk[j] * fsum ;
+        if ( j % 2 == 1 ) {
+            gauss += wg[j/2] * fsum ;
+        }
+    }
+    *err = fabs( ( kronrod - gauss ) * half ) ;
+    return kronrod * half ;
+}
+
+// recursive bisection until the error estimate is within tolerance
+static double adapt( const struct integrand * f, double lo, double hi, double tol, int depth )
+{
+    double err ;
+    double result = gk15( f, lo, hi, &err ) ;
+    if ( err <= tol || err <= 1e-15 * fabs( result ) || depth == 0 ) {
+        return result ;
+    }
+    double mid = 0.5 * ( lo + hi ) ;
+    return adapt( f, lo, mid, tol/2, depth-1 ) + adapt( f, mid, hi, tol/2, depth-1 ) ;
+}
+
+double exact_length( int dimension, double p )
+{
+    double a = 1. / p ;
+    int n = (int) floor( a ) ;
+    double b = a - n ;
+
+    // Terms of the small-t series and the moments they need
+    int K = 12 ;
+    double e[n+K+1] ;
+    double moments[n+K+1] ;
+    one_dim( p, 0., n+K, e ) ;
+    all_dim( dimension, e, n+K, moments ) ;
+
+    if ( b < 1e-12 ) {
+        // integer 1/p -- just a moment
+        return moments[n] ;
+    }
+
+    struct integrand f = { dimension, p, n, b, moments[n] } ;
+
+    // [0,t0] -- expand exp(-tS) in a power series
+    // S <= dimension, so terms fall off like (dimension*t0)^k/k!
+    double t0 = 0.05 / dimension ;
+    double head = 0. ;
+    double factorial = 1. ;
+    for ( int k = 1 ; k <= K ; ++k ) {
+        factorial *= k ;
+        double term = moments[n+k] * pow( t0, k-b ) / ( factorial * (k-b) ) ;
+        head += ( k % 2 ) ? term : -term ;
+    }
+
+    // Large t -- incomplete gamma is then the complete gamma function
+    double T = 40. + 2. * ( 2.*a + n + 1. ) ;
+    double tail ;
+    if ( n == 0 ) {
+        // E[exp(-tS)] = (A z - B z^2)^dimension with z = t^-a exactly (to e^-T)
+        // integrate each power of t directly
+        double A = 2. * a * tgamma( a ) ;
+        double B = 2. * a * tgamma( 2.*a ) ;
+        tail = pow( T, -b ) / b ;
+        double binomial = 1. ;
+        for ( int i = 0 ; i <= dimension ; ++i ) {
+            double power = (dimension+i) * a + b ;
+            double c = binomial * pow( A, dimension-i ) * pow( -B, i ) ;
+            tail -= c * pow( T, -power ) / power ;
+            binomial = binomial * (dimension-i) / (i+1) ;
+        }
+    } else {
+        // E[S^n exp(-tS)] falls at least as fast as t^-(n+a*dimension)
+        // push T out until what is left is negligible
+        double power = n + a * dimension + b ;
+        while ( transform( dimension, p, n, T ) * pow( T, -b ) / power > 1e-17 * moments[n] ) {
+            T *= 10. ;
+        }
+        tail = moments[n] * pow( T, -b ) / b
+            - transform( dimension, p, n, T ) * pow( T, -b ) / power ;
+    }
+
+    // [t0,T] -- adaptive Gauss-Kronrod in ln(t)
+    double lo = log( t0 ) ;
+    double hi = log( T ) ;
+    int panels = 16 ;
+    double width = ( hi - lo ) / panels ;
+    double estimate = 0. ;
+    for ( int i = 0 ; i < panels ; ++i ) {
+        double err ;
+        estimate += gk15( &f, lo + i*width, lo + (i+1)*width, &err ) ;
+    }
+    double tol = 1e-14 * ( fabs( estimate ) + fabs( head ) + fabs( tail ) ) / panels ;
+    double body = 0. ;
+    for ( int i = 0 ; i < panels ; ++i ) {
+        body += adapt( &f, lo + i*width, lo + (i+1)*width, tol, 20 ) ;
+    }
+
+    return b / tgamma( 1.-b ) * ( head + body + tail ) ;
+}
+
+double exact_fnorm( int dimension, double p )
+{
+    // the f-norm adds independent dimensions -- no root to take
+    return dimension * moment( p, 1 ) ;
+}
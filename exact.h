@@ -0,0 +1,18 @@
+#ifndef EXACT_H
+#define EXACT_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Deterministic (no random sampling) average distance between
+// two random points in the unit N-cube by numerical integration.
+// Good to about 1e-12 for low dimensions.
+
+// Average Lp length of the segment -- not normalized
+double exact_length( int dimension, double p ) ;
+
+// Average f-norm (no 1/p root) -- not normalized
+double exact_fnorm( int dimension, double p ) ;
+
+#endif /* EXACT_H */
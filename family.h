@@ -0,0 +1,136 @@
+#ifndef FAMILY_H
+#define FAMILY_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Distance families in distance_any, told apart by their value in the power list
+//   p          Lp  (sum dx^p)^(1/p)
+//   0<p<0.1    Lp evaluated stably: sum of expm1(p log dx) = sum(dx^p) - d,
+//              then d^(1/p) * exp(log1p(sum/d)/p). The d^(1/p) would overflow,
+//              so these cells keep their totals in units of d^(1/p)
+//   inf        L-infinity (Chebyshev) -- running max of dx
+//   -k canberra  sum |x-y|/(|x|+|y|) -- needs the coordinates, not just dx
+//   -k angular   angle between the points as vectors from the origin,
+//                from running sums of x*y, x*x and y*y
+// Each is a running value updated once per dimension (family_add),
+// turned into a length for any dimension (family_length).
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+#define SMALL_P 0.1
+#define CANBERRA_VALUE -1. // stand-in power values (also keep cache keys apart)
+#define ANGULAR_VALUE -2.
+
+enum family { FAMILY_LP, FAMILY_SMALL_P, FAMILY_INF, FAMILY_CANBERRA, FAMILY_ANGULAR } ;
+
+static inline enum family family_of( double value )
+{
+    if ( value == CANBERRA_VALUE ) {
+        return FAMILY_CANBERRA ;
+    } else if ( value == ANGULAR_VALUE ) {
+        return FAMILY_ANGULAR ;
+    } else if ( isinf( value ) ) {
+        return FAMILY_INF ;
+    } else if ( value < SMALL_P ) {
+        return FAMILY_SMALL_P ;
+    }
+    return FAMILY_LP ;
+}
+
+// -k name -> stand-in value (0 if unknown)
+static inline double family_parse( const char * name )
+{
+    if ( strcmp( name, "canberra" ) == 0 ) {
+        return CANBERRA_VALUE ;
+    } else if ( strcmp( name, "angular" ) == 0 ) {
+        return ANGULAR_VALUE ;
+    }
+    return 0. ;
+}
+
+// Column heading for the value
+static inline void family_label( char * buf, size_t size, double value )
+{
+    switch ( family_of( value ) ) {
+    case FAMILY_CANBERRA:
+        snprintf( buf, size, "canberra" ) ;
+        break ;
+    case FAMILY_ANGULAR:
+        snprintf( buf, size, "angular" ) ;
+        break ;
+    case FAMILY_INF:
+        snprintf( buf, size, "inf" ) ;
+        break ;
+    case FAMILY_SMALL_P:
+        snprintf( buf, size, "%g", value ) ;
+        break ;
+    default:
+        snprintf( buf, size, "%.2f", value ) ;
+        break ;
+    }
+}
+
+// Add one coordinate (x and y only used by canberra and angular)
+static inline double family_add( enum family family, double p, double running, double dx, double x, double y )
+{
+    switch ( family ) {
+    case FAMILY_SMALL_P:
+        return running + expm1( p * log( dx ) ) ;
+    case FAMILY_INF:
+        return fmax( running, dx ) ;
+    case FAMILY_CANBERRA:
+        return running + ( ( fabs( x ) + fabs( y ) > 0. ) ? dx / ( fabs( x ) + fabs( y ) ) : 0. ) ;
+    case FAMILY_ANGULAR:
+        return running + x * y ;
+    default:
+        return running + pow( dx, p ) ;
+    }
+}
+
+// Length after d coordinates (xx and yy are the angular sums of squares)
+static inline double family_length( enum family family, double p, double running, int d, double xx, double yy )
+{
+    switch ( family ) {
+    case FAMILY_SMALL_P:
+        return exp( log1p( running / d ) / p ) ; // in units of d^(1/p)
+    case FAMILY_INF:
+    case FAMILY_CANBERRA:
+        return running ;
+    case FAMILY_ANGULAR:
+        {
+            double norms = sqrt( xx * yy ) ;
+            double c = ( norms > 0. ) ? running / norms : 1. ;
+            return acos( c > 1. ? 1. : ( c < -1. ? -1. : c ) ) ;
+        }
+    default:
+        return pow( running, 1./p ) ;
+    }
+}
+
+// Any columns that need the coordinates themselves
+static inline int family_coords( int powers, const double * values )
+{
+    for ( int ip = 0 ; ip < powers ; ++ip ) {
+        if ( values[ip] == CANBERRA_VALUE || values[ip] == ANGULAR_VALUE ) {
+            return 1 ;
+        }
+    }
+    return 0 ;
+}
+
+// Only ordinary Lp columns (exact low dimensions and reduced precision handle only those)
+static inline int family_plain( int powers, const double * values )
+{
+    for ( int ip = 0 ; ip < powers ; ++ip ) {
+        if ( family_of( values[ip] ) != FAMILY_LP ) {
+            return 0 ;
+        }
+    }
+    return 1 ;
+}
+
+#endif /* FAMILY_H */
@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "histogram.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+struct histogram * histogram_init( int cells, int bins )
+{
+    struct histogram * h = malloc( sizeof( struct histogram ) ) ;
+    h->cells = cells ;
+    h->bins = bins ;
+    h->pilot = 1 ;
+    h->low = calloc( cells, sizeof( double ) ) ;
+    h->scale = calloc( cells, sizeof( double ) ) ;
+    h->count = calloc( (size_t) cells * ( bins + 2 ), sizeof( unsigned int ) ) ;
+    h->sum = calloc( cells, sizeof( double ) ) ;
+    h->square = calloc( cells, sizeof( double ) ) ;
+    h->samples = 0 ;
+    return h ;
+}
+
+void histogram_free( struct histogram * h )
+{
+    free( h->low ) ;
+    free( h->scale ) ;
+    free( h->count ) ;
+    free( h->sum ) ;
+    free( h->square ) ;
+    free( h ) ;
+}
+
+void histogram_range( struct histogram * h, long pilot_samples, const double * limit )
+{
+    for ( int c = 0 ; c < h->cells ; ++c ) {
+        double mean = pilot_samples ? h->sum[c] / pilot_samples : 0. ;
+        double variance = pilot_samples ? h->square[c] / pilot_samples - mean * mean : 0. ;
+        double spread = HISTOGRAM_SPREAD * sqrt( variance > 0. ? variance : 0. ) ;
+        double low = mean - spread ;
+        double high = mean + spread ;
+        if ( low < 0. ) {
+            low = 0. ;
+        }
+        if ( limit && high > limit[c] ) {
+            high = limit[c] ;
+        }
+        if ( high <= low ) {
+            // no spread seen -- a small range around the mean
+            high = low + 1e-9 * ( 1. + fabs( mean ) ) ;
+        }
+        h->low[c] = low ;
+        h->scale[c] = h->bins / ( high - low ) ;
+    }
+    memset( h->count, 0, (size_t) h->cells * ( h->bins + 2 ) * sizeof( unsigned int ) ) ;
+    h->samples = pilot_samples ;
+    h->pilot = 0 ;
+}
+
+double histogram_edge( const struct histogram * h, int cell, int bin )
+{
+    return h->low[cell] + ( bin - 1 ) / h->scale[cell] ;
+}
+
+double histogram_quantile( const struct histogram * h, int cell, double q )
+{
+    const unsigned int * count = h->count + (size_t) cell * ( h->bins + 2 ) ;
+    double total = 0. ;
+    for ( int b = 0 ; b < h->bins + 2 ; ++b ) {
+        total += count[b] ;
+    }
+    if ( total == 0. ) {
+        return NAN ;
+    }
+
+    // walk up to the bin holding the q'th sample, interpolate inside it
+    double target = q * total ;
+    double below = 0. ;
+    for ( int b = 0 ; b < h->bins + 2 ; ++b ) {
+        if ( below + count[b] >= target && count[b] > 0 ) {
+            if ( b == 0 ) {
+                return histogram_edge( h, cell, 1 ) ; // underflow -- best is the range edge
+            } else if ( b == h->bins + 1 ) {
+                return histogram_edge( h, cell, h->bins + 1 ) ;
+            }
+            double fraction = ( target - below ) / count[b] ;
+            return histogram_edge( h, cell, b ) + fraction / h->scale[cell] ;
+        }
+        below += count[b] ;
+    }
+    return histogram_edge( h, cell, h->bins + 1 ) ;
+}
@@ -0,0 +1,67 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Distribution of segment lengths in every (dimension, power) cell.
+//
+// Each cell is a fixed-bin histogram with an underflow and an overflow bin.
+// The bin range comes from a short pilot run (mean +/- HISTOGRAM_SPREAD
+// standard deviations, kept inside the possible lengths), so adding a length
+// is one multiply and an increment -- bounded cost in the sampling loop.
+// Quantiles are read off by interpolating within a bin.
+//
+// Memory is cells x (bins+2) counts: -d 200 -p 10 with 64 bins is about 530KB
+
+#define HISTOGRAM_BINS 64
+#define HISTOGRAM_PILOT 500 // samples to set the ranges
+#define HISTOGRAM_SPREAD 6. // standard deviations each side of the mean
+
+struct histogram {
+    int cells ;
+    int bins ;
+    int pilot ; // collecting moments for the range, not counts
+    double * low ; // per cell: bottom of the first bin
+    double * scale ; // per cell: bins per unit length
+    unsigned int * count ; // cells x (bins+2): underflow, bins, overflow
+    double * sum ; // pilot moments
+    double * square ;
+    long samples ; // pilot samples
+} ;
+
+struct histogram * histogram_init( int cells, int bins ) ;
+void histogram_free( struct histogram * h ) ;
+
+// End the pilot: set each cell's range from the pilot moments
+// lengths in a cell can't exceed limit[cell] (NULL for no limit)
+void histogram_range( struct histogram * h, long pilot_samples, const double * limit ) ;
+
+// Length below which fraction q of the cell's samples fall (NAN if empty)
+double histogram_quantile( const struct histogram * h, int cell, double q ) ;
+
+// Bin edges for output: bin 0 is underflow, bins+1 overflow
+double histogram_edge( const struct histogram * h, int cell, int bin ) ;
+
+// The sampling loop's part
+static inline void histogram_add( struct histogram * h, int cell, double length )
+{
+    if ( h->pilot ) {
+        h->sum[cell] += length ;
+        h->square[cell] += length * length ;
+        return ;
+    }
+    double position = ( length - h->low[cell] ) * h->scale[cell] ;
+    int bin ;
+    if ( position < 0. ) {
+        bin = 0 ;
+    } else if ( position >= h->bins ) {
+        bin = h->bins + 1 ;
+    } else {
+        bin = (int) position + 1 ;
+    }
+    ++h->count[ cell * ( h->bins + 2 ) + bin ] ;
+}
+
+#endif /* HISTOGRAM_H */
@@ -0,0 +1,170 @@
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Fixed-size sampling kernels for distance
+//
+// A template: kernels.h (made by the Makefile) includes this file once for
+// every power count in KERNEL_POWERS, and again with KERNEL_BATCH set for
+// every tile size. Each copy is sample_prefix, sample_stream or sample_batch
+// of distance.c with Powers (and Batch) fixed at compile time, so the power
+// loops unroll and the cumprod chain stays in registers.
+// No include guard on the template part -- it is meant to be included repeatedly.
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "domain.h"
+#include "moments.h"
+#include "batch.h"
+
+// Every kernel has the same signature -- totals is [Dimensions+1][powers]
+typedef void (*kernel_fn)( int Dimensions, long Randoms, int Exact, enum domain Domain, const double * extent, double * totals, struct moments * mom ) ;
+
+struct kernel {
+    int powers ;
+    int batch ; // tile size, 0 for the prefix and stream kernels
+    kernel_fn prefix ;
+    kernel_fn stream ;
+    kernel_fn batched ;
+} ;
+
+// pth root (p 0-indexed) -- the first two without pow once p is a constant
+static inline double kernel_root( double sum, int p )
+{
+    return ( p == 0 ) ? sum : ( ( p == 1 ) ? sqrt( sum ) : pow( sum, 1./(p+1) ) ) ;
+}
+
+#define KERNEL_JOIN2( a, b ) a ## _ ## b
+#define KERNEL_NAME2( a, b ) KERNEL_JOIN2( a, b )
+#define KERNEL_JOIN3( a, b, c ) a ## _ ## b ## _ ## c
+#define KERNEL_NAME3( a, b, c ) KERNEL_JOIN3( a, b, c )
+
+#endif /* KERNEL_H */
+
+#if defined( KERNEL_POWERS ) && ! defined( KERNEL_BATCH )
+
+// sample_prefix with Powers fixed
+static void KERNEL_NAME2( sample_prefix, KERNEL_POWERS )( int Dimensions, long Randoms, int Exact, enum domain Domain, const double * extent, double * totals_flat, struct moments * mom )
+{
+    double (*totals)[KERNEL_POWERS] = (double (*)[KERNEL_POWERS]) totals_flat ;
+    double sums[Dimensions+1][KERNEL_POWERS];
+    for (int p=0; p<KERNEL_POWERS; ++p) {
+        sums[0][p] = 0.;
+    }
+
+    for (long r = 0; r < Randoms; ++r) {
+        for (int d=1; d <= Dimensions; ++d) {
+            double dx = domain_dx( Domain ) * extent[d-1];
+            double cumprod = 1;
+#pragma GCC unroll 64
+            for (int p=0; p<KERNEL_POWERS; ++p) {
+                cumprod *= dx;
+                sums[d][p] = sums[d-1][p] + cumprod;
+            }
+        }
+
+        for (int d=Exact+1; d <= Dimensions; ++d) {
+#pragma GCC unroll 64
+            for (int p=0; p<KERNEL_POWERS; ++p) {
+                double length = kernel_root( sums[d][p], p );
+                totals[d][p] += length;
+                if (mom) {
+                    moments_add( mom, d*KERNEL_POWERS+p, length ) ;
+                }
+            }
+        }
+    }
+}
+
+// sample_stream with Powers fixed
+static void KERNEL_NAME2( sample_stream, KERNEL_POWERS )( int Dimensions, long Randoms, int Exact, enum domain Domain, const double * extent, double * totals_flat, struct moments * mom )
+{
+    double (*totals)[KERNEL_POWERS] = (double (*)[KERNEL_POWERS]) totals_flat ;
+    double running[KERNEL_POWERS];
+
+    for (long r = 0; r < Randoms; ++r) {
+        for (int p=0; p<KERNEL_POWERS; ++p) {
+            running[p] = 0.;
+        }
+
+        for (int d=1; d <= Dimensions; ++d) {
+            double dx = domain_dx( Domain ) * extent[d-1];
+            double cumprod = 1;
+#pragma GCC unroll 64
+            for (int p=0; p<KERNEL_POWERS; ++p) {
+                cumprod *= dx;
+                running[p] += cumprod;
+            }
+
+            if (d > Exact) {
+#pragma GCC unroll 64
+                for (int p=0; p<KERNEL_POWERS; ++p) {
+                    double length = kernel_root( running[p], p );
+                    totals[d][p] += length;
+                    if (mom) {
+                        moments_add( mom, d*KERNEL_POWERS+p, length ) ;
+                    }
+                }
+            }
+        }
+    }
+}
+
+#elif defined( KERNEL_POWERS ) && defined( KERNEL_BATCH )
+
+// sample_batch with Powers and Batch fixed
+BATCH_CLONES
+static void KERNEL_NAME3( sample_batch, KERNEL_POWERS, KERNEL_BATCH )( int Dimensions, long Randoms, int Exact, enum domain Domain, const double * extent, double * totals_flat, struct moments * mom )
+{
+    double (*totals)[KERNEL_POWERS] = (double (*)[KERNEL_POWERS]) totals_flat ;
+    double tile[KERNEL_POWERS][KERNEL_BATCH];
+    double dx[KERNEL_BATCH];
+    double dx_raised[KERNEL_BATCH];
+    double length[KERNEL_BATCH];
+
+    for (long r = 0; r < Randoms; r += KERNEL_BATCH) {
+        int size = ( Randoms - r < KERNEL_BATCH ) ? (int) ( Randoms - r ) : KERNEL_BATCH ;
+
+        for (int p=0; p<KERNEL_POWERS; ++p) {
+            for (int b=0; b<KERNEL_BATCH; ++b) {
+                tile[p][b] = 0.;
+            }
+        }
+
+        for (int d=1; d <= Dimensions; ++d) {
+            // a short last batch fills the whole tile and folds only size of it
+            domain_fill( Domain, size, dx );
+            for (int b=0; b<KERNEL_BATCH; ++b) {
+                dx[b] = ( b < size ) ? dx[b] * extent[d-1] : 0. ;
+                dx_raised[b] = 1.;
+            }
+#pragma GCC unroll 64
+            for (int p=0; p<KERNEL_POWERS; ++p) {
+                for (int b=0; b<KERNEL_BATCH; ++b) {
+                    dx_raised[b] *= dx[b];
+                    tile[p][b] += dx_raised[b];
+                }
+            }
+
+            if (d > Exact) {
+#pragma GCC unroll 64
+                for (int p=0; p<KERNEL_POWERS; ++p) {
+                    double sum = 0.;
+                    for (int b=0; b<size; ++b) {
+                        length[b] = kernel_root( tile[p][b], p );
+                        sum += length[b];
+                    }
+                    totals[d][p] += sum;
+                    if (mom) {
+                        for (int b=0; b<size; ++b) {
+                            moments_add( mom, d*KERNEL_POWERS+p, length[b] ) ;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+#endif
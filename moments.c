@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "moments.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+struct moments * moments_init( int cells )
+{
+    struct moments * m = malloc( sizeof( struct moments ) ) ;
+    m->cells = cells ;
+    m->cell = calloc( cells, sizeof( struct moment ) ) ;
+    return m ;
+}
+
+void moments_free( struct moments * m )
+{
+    free( m->cell ) ;
+    free( m ) ;
+}
+
+void moments_clear( struct moments * m )
+{
+    memset( m->cell, 0, m->cells * sizeof( struct moment ) ) ;
+}
+
+// Pairwise combination of two sets of central moments into a
+static void moments_combine( struct moment * a, const struct moment * b )
+{
+    if ( b->n == 0. ) {
+        return ;
+    }
+    if ( a->n == 0. ) {
+        a->n = b->n ;
+        a->mean = b->mean ;
+        a->m2 = b->m2 ;
+        a->m3 = b->m3 ;
+        a->m4 = b->m4 ;
+        return ;
+    }
+    double n = a->n + b->n ;
+    double delta = b->mean - a->mean ;
+    double delta2 = delta * delta ;
+    double na_nb = a->n * b->n ;
+
+    double m4 = a->m4 + b->m4
+        + delta2 * delta2 * na_nb * ( a->n*a->n - na_nb + b->n*b->n ) / ( n*n*n )
+        + 6. * delta2 * ( a->n*a->n * b->m2 + b->n*b->n * a->m2 ) / ( n*n )
+        + 4. * delta * ( a->n * b->m3 - b->n * a->m3 ) / n ;
+    double m3 = a->m3 + b->m3
+        + delta * delta2 * na_nb * ( a->n - b->n ) / ( n*n )
+        + 3. * delta * ( a->n * b->m2 - b->n * a->m2 ) / n ;
+    double m2 = a->m2 + b->m2 + delta2 * na_nb / n ;
+
+    a->mean += delta * b->n / n ;
+    a->m2 = m2 ;
+    a->m3 = m3 ;
+    a->m4 = m4 ;
+    a->n = n ;
+}
+
+void moments_flush( struct moment * c )
+{
+    if ( c->count == 0. ) {
+        return ;
+    }
+    // central moments of the block from its shifted sums
+    struct moment block ;
+    double k = c->count ;
+    double delta = c->s1 / k ; // block mean - shift
+    double delta2 = delta * delta ;
+    block.n = k ;
+    block.mean = c->shift + delta ;
+    block.m2 = c->s2 - k * delta2 ;
+    block.m3 = c->s3 - 3. * delta * c->s2 + 2. * k * delta2 * delta ;
+    block.m4 = c->s4 - 4. * delta * c->s3 + 6. * delta2 * c->s2 - 3. * k * delta2 * delta2 ;
+    moments_combine( c, &block ) ;
+
+    // next block shifted by the mean so far
+    c->shift = c->mean ;
+    c->count = 0. ;
+    c->s1 = c->s2 = c->s3 = c->s4 = 0. ;
+}
+
+void moments_merge( struct moments * into, struct moments * from )
+{
+    for ( int i = 0 ; i < into->cells ; ++i ) {
+        moments_flush( &into->cell[i] ) ;
+        moments_flush( &from->cell[i] ) ;
+        moments_combine( &into->cell[i], &from->cell[i] ) ;
+    }
+}
+
+double moments_variance( struct moments * m, int cell )
+{
+    struct moment * c = &m->cell[cell] ;
+    moments_flush( c ) ;
+    return ( c->n > 1. ) ? c->m2 / ( c->n - 1. ) : NAN ;
+}
+
+double moments_skew( struct moments * m, int cell )
+{
+    struct moment * c = &m->cell[cell] ;
+    moments_flush( c ) ;
+    return ( c->n > 2. && c->m2 > 0. ) ? sqrt( c->n ) * c->m3 / pow( c->m2, 1.5 ) : NAN ;
+}
+
+double moments_kurtosis( struct moments * m, int cell )
+{
+    struct moment * c = &m->cell[cell] ;
+    moments_flush( c ) ;
+    return ( c->n > 3. && c->m2 > 0. ) ? c->n * c->m4 / ( c->m2 * c->m2 ) - 3. : NAN ;
+}
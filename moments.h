@@ -0,0 +1,74 @@
+#ifndef MOMENTS_H
+#define MOMENTS_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Central moments (to the fourth) of the segment length in every cell, in one pass.
+//
+// The sampling loop only adds powers of (length - shift) to a block of sums,
+// with the shift the cell's mean so far (its first length to start), so there
+// is no division and little cancellation. Every MOMENTS_BLOCK lengths the
+// block becomes central moments and is merged in with the pairwise formulas
+// of Pebay (Sandia report SAND2008-6212), which also merge accumulations
+// from threads or separate runs exactly.
+
+#define MOMENTS_BLOCK 256
+
+struct moment {
+    double n ; // samples merged
+    double mean ;
+    double m2 ; // sums of powers of deviations from the mean
+    double m3 ;
+    double m4 ;
+    // current block
+    double shift ;
+    double count ;
+    double s1 ; // sums of powers of (length - shift)
+    double s2 ;
+    double s3 ;
+    double s4 ;
+} ;
+
+struct moments {
+    int cells ;
+    struct moment * cell ;
+} ;
+
+struct moments * moments_init( int cells ) ;
+void moments_free( struct moments * m ) ;
+void moments_clear( struct moments * m ) ; // back to no samples
+
+// Merge a cell's current block into its moments
+void moments_flush( struct moment * c ) ;
+
+// Add all of from's samples into into (same cells)
+void moments_merge( struct moments * into, struct moments * from ) ;
+
+// Sample variance, skewness and excess kurtosis of a cell (NAN if too few samples)
+// (call after the last moments_add)
+double moments_variance( struct moments * m, int cell ) ;
+double moments_skew( struct moments * m, int cell ) ;
+double moments_kurtosis( struct moments * m, int cell ) ;
+
+// The sampling loop's part -- one more length for the cell
+static inline void moments_add( struct moments * m, int cell, double x )
+{
+    struct moment * c = &m->cell[cell] ;
+    if ( c->n == 0. && c->count == 0. ) {
+        c->shift = x ;
+    }
+    double d = x - c->shift ;
+    double d2 = d * d ;
+    c->s1 += d ;
+    c->s2 += d2 ;
+    c->s3 += d2 * d ;
+    c->s4 += d2 * d2 ;
+    c->count += 1. ;
+    if ( c->count >= MOMENTS_BLOCK ) {
+        moments_flush( c ) ;
+    }
+}
+
+#endif /* MOMENTS_H */
@@ -0,0 +1,186 @@
+#define _GNU_SOURCE // sched_setaffinity and the CPU_ macros
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
+#include "place.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+static int place_node_of( int numa, int cpu )
+{
+#ifdef HAVE_NUMA
+    if ( numa ) {
+        int node = numa_node_of_cpu( cpu ) ;
+        return ( node < 0 ) ? 0 : node ;
+    }
+#endif
+    (void) numa ;
+    (void) cpu ;
+    return 0 ;
+}
+
+struct place * place_init( int workers )
+{
+    struct place * pl = malloc( sizeof( struct place ) ) ;
+    pl->workers = workers ;
+    pl->numa = 0 ;
+#ifdef HAVE_NUMA
+    pl->numa = ( numa_available() >= 0 ) ;
+#endif
+    pl->cpu = malloc( workers * sizeof( int ) ) ;
+    pl->node = malloc( workers * sizeof( int ) ) ;
+    pl->leader = malloc( workers * sizeof( int ) ) ;
+
+    // allowed processors with their nodes
+    cpu_set_t set ;
+    int count = 0 ;
+    CPU_ZERO( &set ) ;
+    if ( sched_getaffinity( 0, sizeof( set ), &set ) == 0 ) {
+        count = CPU_COUNT( &set ) ;
+    }
+    int cpus[count > 0 ? count : 1] ;
+    int nodes_of[count > 0 ? count : 1] ;
+    int maxnode = 0 ;
+    for ( int c = 0, i = 0 ; i < count && c < CPU_SETSIZE ; ++c ) {
+        if ( CPU_ISSET( c, &set ) ) {
+            cpus[i] = c ;
+            nodes_of[i] = place_node_of( pl->numa, c ) ;
+            if ( nodes_of[i] > maxnode ) {
+                maxnode = nodes_of[i] ;
+            }
+            ++i ;
+        }
+    }
+
+    // order: the first processor of every node, then the second ...
+    int order[count > 0 ? count : 1] ;
+    int placed = 0 ;
+    for ( int round = 0 ; placed < count ; ++round ) {
+        for ( int n = 0 ; n <= maxnode ; ++n ) {
+            int seen = 0 ;
+            for ( int i = 0 ; i < count ; ++i ) {
+                if ( nodes_of[i] == n && seen++ == round ) {
+                    order[placed++] = i ;
+                    break ;
+                }
+            }
+        }
+    }
+
+    int pin = ( workers > 1 && count > 0 ) ;
+    for ( int w = 0 ; w < workers ; ++w ) {
+        int i = ( count > 0 ) ? order[w % count] : 0 ;
+        pl->cpu[w] = pin ? cpus[i] : -1 ;
+        pl->node[w] = pin ? nodes_of[i] : 0 ;
+    }
+
+    // leaders and node count
+    pl->nodes = 0 ;
+    for ( int w = 0 ; w < workers ; ++w ) {
+        pl->leader[w] = w ;
+        for ( int v = 0 ; v < w ; ++v ) {
+            if ( pl->node[v] == pl->node[w] ) {
+                pl->leader[w] = v ;
+                break ;
+            }
+        }
+        if ( pl->leader[w] == w ) {
+            ++pl->nodes ;
+        }
+    }
+    return pl ;
+}
+
+void place_free( struct place * pl )
+{
+    free( pl->cpu ) ;
+    free( pl->node ) ;
+    free( pl->leader ) ;
+    free( pl ) ;
+}
+
+void place_pin( struct place * pl, int worker )
+{
+    if ( pl->cpu[worker] < 0 ) {
+        return ;
+    }
+    cpu_set_t set ;
+    CPU_ZERO( &set ) ;
+    CPU_SET( pl->cpu[worker], &set ) ;
+    sched_setaffinity( 0, sizeof( set ), &set ) ; // 0 is the calling thread; failure just leaves it unpinned
+}
+
+double * place_zeros( struct place * pl, size_t cells )
+{
+    double * array ;
+#ifdef HAVE_NUMA
+    if ( pl->numa ) {
+        array = numa_alloc_local( cells * sizeof( double ) ) ;
+    } else
+#endif
+    {
+        array = malloc( cells * sizeof( double ) ) ;
+    }
+    (void) pl ;
+    // written here rather than by calloc, so the pages are first touched by this thread
+    memset( array, 0, cells * sizeof( double ) ) ;
+    return array ;
+}
+
+double * place_spread( struct place * pl, size_t cells )
+{
+#ifdef HAVE_NUMA
+    if ( pl->numa && pl->nodes > 1 ) {
+        return numa_alloc_interleaved( cells * sizeof( double ) ) ;
+    }
+    if ( pl->numa ) {
+        return numa_alloc_local( cells * sizeof( double ) ) ;
+    }
+#endif
+    (void) pl ;
+    return malloc( cells * sizeof( double ) ) ;
+}
+
+void place_release( struct place * pl, double * array, size_t cells )
+{
+#ifdef HAVE_NUMA
+    if ( pl->numa ) {
+        numa_free( array, cells * sizeof( double ) ) ;
+        return ;
+    }
+#endif
+    (void) pl ;
+    (void) cells ;
+    free( array ) ;
+}
+
+void place_reduce( struct place * pl, int worker, double ** arrays, size_t cells )
+{
+    if ( pl->leader[worker] != worker ) {
+        return ;
+    }
+    for ( int w = worker + 1 ; w < pl->workers ; ++w ) {
+        if ( pl->leader[w] == worker ) {
+            for ( size_t i = 0 ; i < cells ; ++i ) {
+                arrays[worker][i] += arrays[w][i] ;
+            }
+        }
+    }
+}
+
+void place_total( struct place * pl, double ** arrays, size_t cells, double * totals )
+{
+    for ( int w = 0 ; w < pl->workers ; ++w ) {
+        if ( pl->leader[w] == w ) {
+            for ( size_t i = 0 ; i < cells ; ++i ) {
+                totals[i] += arrays[w][i] ;
+            }
+        }
+    }
+}
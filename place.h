@@ -0,0 +1,54 @@
+#ifndef PLACE_H
+#define PLACE_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Thread placement for multi-socket machines
+//
+// Workers are pinned one per processor, spread across the NUMA nodes in turn
+// (node 0, node 1, ... then the second processor of each), using only the
+// processors the process is allowed (so taskset still works). Each worker
+// allocates its own accumulators after pinning, and Linux puts a page on the
+// node of the thread that first writes it -- so the sampling loop never
+// touches another socket's memory. At the end each node's lowest-numbered
+// worker (its leader) adds up that node's arrays locally, and only the
+// leaders' sums cross sockets to the final total.
+//
+// The node of each processor comes from libnuma when built with HAVE_NUMA
+// (the Makefile adds it if libnuma is installed); otherwise every processor
+// counts as node 0, which still pins the workers. A single worker isn't pinned.
+
+#include <stddef.h>
+
+struct place {
+    int workers ;
+    int nodes ; // nodes with workers on them
+    int numa ; // libnuma usable -- node-local and interleaved allocations
+    int * cpu ; // processor for each worker (-1 not pinned)
+    int * node ; // node of each worker
+    int * leader ; // lowest-numbered worker on the same node
+} ;
+
+struct place * place_init( int workers ) ;
+void place_free( struct place * pl ) ;
+
+// Worker: pin the calling thread to its processor
+void place_pin( struct place * pl, int worker ) ;
+
+// Worker: zeroed array written by the calling thread, so on its node
+double * place_zeros( struct place * pl, size_t cells ) ;
+void place_release( struct place * pl, double * array, size_t cells ) ;
+
+// Shared read-mostly array, pages interleaved over the nodes
+double * place_spread( struct place * pl, size_t cells ) ;
+
+// Worker, once every worker's array is finished (after a barrier):
+// a leader adds the other arrays on its node into its own
+void place_reduce( struct place * pl, int worker, double ** arrays, size_t cells ) ;
+
+// Afterwards: the leaders' arrays added into totals
+void place_total( struct place * pl, double ** arrays, size_t cells, double * totals ) ;
+
+#endif /* PLACE_H */
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rangelist.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+struct rangelist * rangelist_init( void ) {
+    struct rangelist * rl = malloc( sizeof ( struct rangelist ) ) ;
+    rl->alloc = 100 ;
+    rl->size = 0 ;
+    rl->val = malloc( rl->alloc * sizeof( double ) ) ;
+    return rl ;
+}
+
+static void rangelist_inc( struct rangelist * rl ) {
+    rl->alloc += 100 ;
+    rl->val = realloc( rl->val, rl->alloc * sizeof(double) ) ;
+}
+
+void rangelist_add( double p, struct rangelist * rl ) {
+    if ( rl->size == rl->alloc ) {
+        rangelist_inc( rl ) ;
+    }
+    rl->val[rl->size++] = p ;
+}
+
+void rangelist_free( struct rangelist * rl ) {
+    free( rl->val ) ;
+    free( rl ) ;
+}
+
+int rangelist_finite( struct rangelist * rl ) {
+    int kept = 0 ;
+    for (int i = 0 ; i < rl->size ; ++i ) {
+        if ( ! isinf( rl->val[i] ) ) {
+            rl->val[kept++] = rl->val[i] ;
+        }
+    }
+    int dropped = rl->size - kept ;
+    rl->size = kept ;
+    return dropped ;
+}
+
+void rangelist_print( struct rangelist * rl ) {
+    printf("Ranglist size=%d alloc=%d values= ",rl->size,rl->alloc);
+    for (int i = 0 ; i < rl->size ; ++i ) {
+        printf("%f ",rl->val[i]);
+    }
+    printf("\n") ;
+}
+
+struct rangelist * range( char * p_string )
+{
+    // Interpret the string as a list of power values
+    // individual 1,2, 5
+    // ranges 1 _ 6
+    // inf for the max metric
+
+    char * rcopy = strdup( p_string ) ;
+    //printf("Full %s\n",rcopy) ;
+
+    struct rangelist * rl = rangelist_init() ;
+    
+    char * rcomma ;
+    char * rthis = strtok_r( rcopy, ",", &rcomma ) ;
+
+    while ( rthis != NULL ) {
+        //printf("Comma %s\n",rthis);
+
+        char * rbar ;
+        char * rthat = strtok_r( rthis, "_", &rbar ) ;
+        double p_val[3] ; // extent of range
+        int p_num = 0 ; // range elements
+
+        while ( rthat != NULL ) {
+            //printf("\t Bar %s\n",rthat) ;
+            if ( p_num == 3 ) {
+                // only 3 entries in range allowed
+                break ;
+            }
+            double v = atof(rthat) ;
+            if (v <= 0.) {
+                v = 1. ;
+            }
+            p_val[p_num++] = v ;
+
+            rthat = strtok_r( NULL, "_", &rbar ) ;
+        }
+
+        if ( p_num > 0 && ( isinf( p_val[0] ) || ( p_num > 1 && isinf( p_val[1] ) ) ) ) {
+            // "inf" (the max metric) is a value of its own, not a range end
+            rangelist_add( INFINITY, rl ) ;
+            p_num = 0 ;
+        }
+
+        switch (p_num) {
+        case 0:
+            // no entries
+            break ;
+        case 1:
+            // single entry
+            p_val[1] = p_val[0] ;
+            // fall through ...
+        case 2:
+            // straight range
+            p_val[2] = 1 ;
+            // fall through ...
+        case 3:
+            for ( double v = p_val[0]; v <= p_val[1] ; v += p_val[2] ) {
+                rangelist_add( v, rl ) ;
+            }
+        }
+
+        rthis = strtok_r( NULL, "," , &rcomma ) ;
+    }
+
+    free( rcopy ) ;
+
+    return rl ;
+}
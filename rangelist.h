@@ -0,0 +1,26 @@
+#ifndef RANGELIST_H
+#define RANGELIST_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// List of (possibly non-integer) powers parsed from the -p option
+// e.g. "1_20_3,.5,100,inf"
+struct rangelist {
+    int size ;
+    int alloc ;
+    double * val ;
+} ;
+
+struct rangelist * rangelist_init( void ) ;
+void rangelist_add( double p, struct rangelist * rl ) ;
+void rangelist_free( struct rangelist * rl ) ;
+// Remove any inf values, returns how many
+int rangelist_finite( struct rangelist * rl ) ;
+void rangelist_print( struct rangelist * rl ) ;
+
+// Interpret the string as a list of power values
+struct rangelist * range( char * p_string ) ;
+
+#endif /* RANGELIST_H */
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "refine.h"
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Totals are read and written with relaxed atomics, so the race between
+// worker and reader is defined; the fences give the seqlock ordering.
+// A slot's totals are allocated by its worker on the first publish, so on a
+// NUMA machine they sit on the worker's node (first touch) -- until then the
+// reader sees a null pointer and an empty slot.
+
+struct refine * refine_init( int threads, size_t cells )
+{
+    struct refine * rf = malloc( sizeof( struct refine ) ) ;
+    rf->threads = threads ;
+    rf->cells = cells ;
+    rf->slots = aligned_alloc( 64, threads * sizeof( struct refine_slot ) ) ;
+    for ( int t = 0 ; t < threads ; ++t ) {
+        rf->slots[t].sequence = 0 ;
+        rf->slots[t].samples = 0 ;
+        rf->slots[t].totals = NULL ;
+    }
+    return rf ;
+}
+
+void refine_free( struct refine * rf )
+{
+    for ( int t = 0 ; t < rf->threads ; ++t ) {
+        free( rf->slots[t].totals ) ;
+    }
+    free( rf->slots ) ;
+    free( rf ) ;
+}
+
+void refine_publish( struct refine * rf, int thread, const double * totals, long samples )
+{
+    struct refine_slot * slot = &rf->slots[thread] ;
+    unsigned long sequence = slot->sequence ; // only this thread writes it
+
+    if ( slot->totals == NULL ) {
+        double * mine = malloc( rf->cells * sizeof( double ) ) ;
+        memset( mine, 0, rf->cells * sizeof( double ) ) ; // first touch by the worker
+        __atomic_store_n( &slot->totals, mine, __ATOMIC_RELEASE ) ;
+    }
+    __atomic_store_n( &slot->sequence, sequence + 1, __ATOMIC_RELAXED ) ;
+    __atomic_thread_fence( __ATOMIC_RELEASE ) ; // odd count visible before any total changes
+    for ( size_t i = 0 ; i < rf->cells ; ++i ) {
+        double sum = slot->totals[i] + totals[i] ;
+        __atomic_store( &slot->totals[i], &sum, __ATOMIC_RELAXED ) ;
+    }
+    __atomic_store_n( &slot->samples, slot->samples + samples, __ATOMIC_RELAXED ) ;
+    __atomic_store_n( &slot->sequence, sequence + 2, __ATOMIC_RELEASE ) ;
+}
+
+// Consistent copy of one slot's totals -- all of them, or count listed cells
+// returns the samples they hold
+static long refine_copy( struct refine_slot * slot, size_t cells, int count, const size_t * cell, double * copy )
+{
+    size_t n = cell ? (size_t) count : cells ;
+    while ( 1 ) {
+        unsigned long before = __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE ) ;
+        if ( before & 1 ) {
+            sched_yield() ; // worker is mid-update
+            continue ;
+        }
+        double * slot_totals = __atomic_load_n( &slot->totals, __ATOMIC_ACQUIRE ) ;
+        for ( size_t i = 0 ; i < n ; ++i ) {
+            if ( slot_totals ) {
+                __atomic_load( &slot_totals[cell ? cell[i] : i], &copy[i], __ATOMIC_RELAXED ) ;
+            } else {
+                copy[i] = 0. ;
+            }
+        }
+        long samples = __atomic_load_n( &slot->samples, __ATOMIC_RELAXED ) ;
+        __atomic_thread_fence( __ATOMIC_ACQUIRE ) ; // copies done before the recheck
+        unsigned long after = __atomic_load_n( &slot->sequence, __ATOMIC_RELAXED ) ;
+        if ( before == after ) {
+            return samples ;
+        }
+    }
+}
+
+long refine_snapshot( struct refine * rf, double * totals )
+{
+    double * copy = malloc( rf->cells * sizeof( double ) ) ;
+    long samples = 0 ;
+    memset( totals, 0, rf->cells * sizeof( double ) ) ;
+
+    for ( int t = 0 ; t < rf->threads ; ++t ) {
+        samples += refine_copy( &rf->slots[t], rf->cells, 0, NULL, copy ) ;
+        for ( size_t i = 0 ; i < rf->cells ; ++i ) {
+            totals[i] += copy[i] ;
+        }
+    }
+    free( copy ) ;
+    return samples ;
+}
+
+long refine_snapshot_cells( struct refine * rf, int count, const size_t * cell, double * values )
+{
+    double copy[count] ;
+    long samples = 0 ;
+    for ( int i = 0 ; i < count ; ++i ) {
+        values[i] = 0. ;
+    }
+
+    for ( int t = 0 ; t < rf->threads ; ++t ) {
+        samples += refine_copy( &rf->slots[t], rf->cells, count, cell, copy ) ;
+        for ( int i = 0 ; i < count ; ++i ) {
+            values[i] += copy[i] ;
+        }
+    }
+    return samples ;
+}
+
+long refine_samples( struct refine * rf )
+{
+    long samples = 0 ;
+    for ( int t = 0 ; t < rf->threads ; ++t ) {
+        samples += __atomic_load_n( &rf->slots[t].samples, __ATOMIC_RELAXED ) ;
+    }
+    return samples ;
+}
@@ -0,0 +1,44 @@
+#ifndef REFINE_H
+#define REFINE_H
+
+// part of distance -- finding average distance in an N-cube
+// by Paul H Alfille 2021
+// see http://github.com/alfille/distance
+
+// Continuous refinement: worker threads add samples forever while a reader
+// takes consistent snapshots of the totals without stopping them.
+//
+// Each worker owns one slot (totals and sample count) and is its only writer.
+// A slot's sequence counter is odd while the worker is adding to it; a reader
+// copies the slot and tries again if the counter was odd or changed meanwhile
+// (a seqlock). No locks are taken by either side.
+
+struct refine_slot {
+    unsigned long sequence ;
+    long samples ;
+    double * totals ;
+} __attribute__(( aligned( 64 ) )) ; // own cache line -- no false sharing
+
+struct refine {
+    int threads ;
+    size_t cells ;
+    struct refine_slot * slots ;
+} ;
+
+struct refine * refine_init( int threads, size_t cells ) ;
+void refine_free( struct refine * rf ) ;
+
+// Worker: add a chunk of totals for samples more samples to its slot
+void refine_publish( struct refine * rf, int thread, const double * totals, long samples ) ;
+
+// Reader: sum of all slots into totals, returns the sample count they hold
+long refine_snapshot( struct refine * rf, double * totals ) ;
+
+// Reader: the same for just count cells (indexes in cell) into values
+// -- each slot's cells are consistent with each other and its sample count
+long refine_snapshot_cells( struct refine * rf, int count, const size_t * cell, double * values ) ;
+
+// Reader: just the sample count (may be a little out of date)
+long refine_samples( struct refine * rf ) ;
+
+#endif /* REFINE_H */